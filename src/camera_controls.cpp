@@ -0,0 +1,171 @@
+#include <sys/ioctl.h>
+
+#include <linux/videodev2.h>
+
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#include "easylogging++/easylogging++.h"
+
+#include "camera_controls.hpp"
+
+static std::string
+trim(const std::string& text)
+{
+    auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return std::string();
+    }
+
+    auto last = text.find_last_not_of(" \t\r");
+
+    return text.substr(first, last - first + 1);
+}
+
+static std::string
+normalize_control_name(const char* name)
+{
+    std::string result;
+    bool separator = false;
+
+    for (auto p = name; *p != '\0'; p++) {
+        auto c = static_cast<unsigned char>(*p);
+        if (std::isalnum(c)) {
+            if (separator and not result.empty()) {
+                result.push_back('_');
+            }
+            result.push_back(std::tolower(c));
+            separator = false;
+        } else {
+            separator = true;
+        }
+    }
+
+    return result;
+}
+
+bool
+parse_control_setting(const std::string& text, ControlSetting& setting)
+{
+    auto pos = text.find('=');
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    setting.name = trim(text.substr(0, pos));
+    auto value = trim(text.substr(pos + 1));
+    if (setting.name.empty() or value.empty()) {
+        return false;
+    }
+
+    char* end = nullptr;
+    errno = 0;
+    auto number = std::strtol(value.c_str(), &end, 0);
+    if (errno != 0 or *end != '\0' or number < INT32_MIN or number > INT32_MAX) {
+        return false;
+    }
+
+    setting.value = static_cast<int32_t>(number);
+
+    return true;
+}
+
+bool
+load_control_settings(const std::string& path, ControlSettings& settings)
+{
+    std::ifstream file(path);
+    if (not file) {
+        LOG(ERROR) << "can't open controls file '" << path << "': " << strerror(errno);
+        return false;
+    }
+
+    std::string line;
+    for (int line_number = 1; std::getline(file, line); line_number++) {
+        line = trim(line);
+        if (line.empty() or line[0] == '#') {
+            continue;
+        }
+
+        ControlSetting setting;
+        if (not parse_control_setting(line, setting)) {
+            LOG(ERROR) << path << ":" << line_number << ": expected name=value, got '" << line << "'";
+            return false;
+        }
+
+        settings.push_back(setting);
+    }
+
+    return true;
+}
+
+bool
+apply_control_settings(int fd, const std::string& device, const ControlSettings& settings)
+{
+    if (settings.empty()) {
+        return true;
+    }
+
+    std::map<std::string, struct v4l2_queryctrl> controls;
+
+    struct v4l2_queryctrl queryctrl;
+    std::memset(&queryctrl, 0, sizeof(queryctrl));
+    queryctrl.id = V4L2_CTRL_FLAG_NEXT_CTRL;
+
+    while (ioctl(fd, VIDIOC_QUERYCTRL, &queryctrl) == 0) {
+        if (queryctrl.type != V4L2_CTRL_TYPE_CTRL_CLASS) {
+            controls[normalize_control_name(reinterpret_cast<const char*>(queryctrl.name))] = queryctrl;
+        }
+        queryctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+    }
+
+    for (const auto& setting : settings) {
+        auto it = controls.find(setting.name);
+        if (it == controls.end()) {
+            LOG(ERROR) << device << " has no control '" << setting.name << "'";
+            return false;
+        }
+
+        const auto& info = it->second;
+        if (info.flags & (V4L2_CTRL_FLAG_DISABLED | V4L2_CTRL_FLAG_READ_ONLY)) {
+            LOG(ERROR) << "control '" << setting.name << "' of " << device << " can't be changed";
+            return false;
+        }
+
+        if (setting.value < info.minimum or setting.value > info.maximum) {
+            LOG(ERROR) << "value " << setting.value << " of control '" << setting.name << "' is out of range [" << info.minimum << ", "
+                       << info.maximum << "] of " << device;
+            return false;
+        }
+
+        struct v4l2_control control;
+        std::memset(&control, 0, sizeof(control));
+        control.id = info.id;
+        control.value = setting.value;
+
+        if (ioctl(fd, VIDIOC_S_CTRL, &control) < 0) {
+            // EACCES usually means the control is inactive in the current automatic mode
+            LOG(ERROR) << "setting control '" << setting.name << "' of " << device << " failed: " << strerror(errno);
+            return false;
+        }
+
+        if (info.flags & V4L2_CTRL_FLAG_WRITE_ONLY) {
+            continue;
+        }
+
+        if (ioctl(fd, VIDIOC_G_CTRL, &control) < 0) {
+            LOG(ERROR) << "VIDIOC_G_CTRL failed for control '" << setting.name << "' of " << device << ": " << strerror(errno);
+            return false;
+        }
+
+        if (control.value != setting.value) {
+            LOG(WARNING) << device << " has set control '" << setting.name << "' to " << control.value << " instead of " << setting.value;
+        }
+    }
+
+    return true;
+}
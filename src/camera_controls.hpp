@@ -0,0 +1,30 @@
+#ifndef UVCCAPTURE2_CAMERA_CONTROLS_HPP
+#define UVCCAPTURE2_CAMERA_CONTROLS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Value for a V4L2 control, the control is named the way v4l2-ctl names it:
+// lowercase with runs of other characters replaced by '_', e.g.
+// exposure_auto_priority or white_balance_temperature.
+struct ControlSetting {
+    std::string name;
+    int32_t value = 0;
+};
+
+using ControlSettings = std::vector<ControlSetting>;
+
+// Parses "name=value".
+bool parse_control_setting(const std::string& text, ControlSetting& setting);
+
+// Reads a file with a "name=value" per line, empty lines and lines starting
+// with '#' are skipped. Settings are appended in the order of the file.
+bool load_control_settings(const std::string& path, ControlSettings& settings);
+
+// Sets the controls in the given order, so automatic modes have to precede
+// manual values they gate (e.g. exposure_auto=1 before exposure_absolute),
+// and reads every control back to check the driver has kept the value.
+bool apply_control_settings(int fd, const std::string& device, const ControlSettings& settings);
+
+#endif
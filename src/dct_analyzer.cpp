@@ -0,0 +1,110 @@
+#include <setjmp.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include <jpeglib.h>
+
+#include "dct_analyzer.hpp"
+
+/* dequantized DC coefficient is 8 times the block's mean sample offset from the middle */
+static const int kDCScale = 8;
+static const int kCenterSample = 128;
+static const int kMaxSample = 255;
+
+struct AnalyzerErrorManager {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+    char message[JMSG_LENGTH_MAX];
+};
+
+struct DCTAnalyzer::Decoder {
+    struct jpeg_decompress_struct cinfo;
+    AnalyzerErrorManager error;
+};
+
+static void
+error_exit_cb(j_common_ptr cinfo)
+{
+    // cinfo->err points to the pub field of AnalyzerErrorManager
+    auto error = reinterpret_cast<AnalyzerErrorManager*>(cinfo->err);
+
+    error->pub.format_message(cinfo, error->message);
+    longjmp(error->setjmp_buffer, 1);
+}
+
+static void
+output_message_cb(j_common_ptr)
+{
+    // corrupt data warnings don't matter for the statistics
+}
+
+DCTAnalyzer::DCTAnalyzer()
+    : decoder(new Decoder)
+{
+    decoder->cinfo.err = jpeg_std_error(&decoder->error.pub);
+    decoder->error.pub.error_exit = error_exit_cb;
+    decoder->error.pub.output_message = output_message_cb;
+
+    jpeg_create_decompress(&decoder->cinfo);
+}
+
+DCTAnalyzer::~DCTAnalyzer()
+{
+    jpeg_destroy_decompress(&decoder->cinfo);
+}
+
+bool
+DCTAnalyzer::analyze(const unsigned char* data, size_t size)
+{
+    auto& cinfo = decoder->cinfo;
+
+    if (setjmp(decoder->error.setjmp_buffer)) {
+        jpeg_abort_decompress(&cinfo);
+        error_message = decoder->error.message;
+        return false;
+    }
+
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data), size);
+    jpeg_read_header(&cinfo, TRUE);
+
+    auto coefficients = jpeg_read_coefficients(&cinfo);
+    const auto& luma = cinfo.comp_info[0];
+
+    int quant[DCTSIZE2];
+    for (int i = 0; i < DCTSIZE2; i++) {
+        quant[i] = luma.quant_table != nullptr ? luma.quant_table->quantval[i] : 1;
+    }
+
+    width = luma.width_in_blocks;
+    height = luma.height_in_blocks;
+    dc.resize(static_cast<size_t>(width) * height);
+
+    uint64_t sum = 0;
+    uint64_t ac_sum = 0;
+    auto pixel = dc.data();
+
+    for (unsigned y = 0; y < height; y++) {
+        auto blocks = cinfo.mem->access_virt_barray(reinterpret_cast<j_common_ptr>(&cinfo), coefficients[0], y, 1, FALSE)[0];
+        for (unsigned x = 0; x < width; x++) {
+            const auto& block = blocks[x];
+
+            int value = kCenterSample + block[0] * quant[0] / kDCScale;
+            *pixel = std::min(std::max(value, 0), kMaxSample);
+            sum += *pixel++;
+
+            // both are in natural order
+            for (int i = 1; i < DCTSIZE2; i++) {
+                ac_sum += std::abs(block[i]) * quant[i];
+            }
+        }
+    }
+
+    mean = dc.empty() ? 0 : static_cast<double>(sum) / dc.size();
+    ac_energy = dc.empty() ? 0 : static_cast<double>(ac_sum) / dc.size();
+
+    jpeg_abort_decompress(&cinfo);
+
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef UVCCAPTURE2_DCT_ANALYZER_HPP
+#define UVCCAPTURE2_DCT_ANALYZER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Looks at frame content without decoding pixels: the entropy-coded data is
+// read into DCT coefficients with jpeg_read_coefficients() and no IDCT,
+// upsampling or color conversion is done. The DC coefficient of every luma
+// block gives the block's mean brightness, so the DC image is a 1/8 x 1/8
+// thumbnail of the frame, and AC coefficients tell how much detail it has.
+class DCTAnalyzer
+{
+public:
+    DCTAnalyzer(const DCTAnalyzer&) = delete;
+    DCTAnalyzer();
+
+    ~DCTAnalyzer();
+
+    bool analyze(const unsigned char* data, size_t size);
+
+    // Luma of every 8x8 block of the last analyzed frame, row by row.
+    const std::vector<uint8_t>&
+    dc_image() const
+    {
+        return dc;
+    }
+
+    unsigned
+    dc_width() const
+    {
+        return width;
+    }
+
+    unsigned
+    dc_height() const
+    {
+        return height;
+    }
+
+    // Mean luma of the last analyzed frame, 0-255.
+    double
+    mean_luma() const
+    {
+        return mean;
+    }
+
+    // Sum of absolute dequantized AC coefficients per luma block of the last
+    // analyzed frame. Blur and defocus take the high frequencies away, so of
+    // frames of the same scene the sharpest has the highest value.
+    double
+    sharpness() const
+    {
+        return ac_energy;
+    }
+
+    std::string
+    error() const
+    {
+        return error_message;
+    }
+
+private:
+    struct Decoder;
+
+    std::unique_ptr<Decoder> decoder;
+
+    std::vector<uint8_t> dc;
+    unsigned width = 0;
+    unsigned height = 0;
+    double mean = 0;
+    double ac_energy = 0;
+
+    std::string error_message;
+};
+
+#endif
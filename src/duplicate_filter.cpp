@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstring>
+
+#include "duplicate_filter.hpp"
+
+static const uint64_t kFNVOffsetBasis = 14695981039346656037ULL;
+static const uint64_t kFNVPrime = 1099511628211ULL;
+static const unsigned kHashGrid = 8;
+/* average hashes ignore overall brightness, frames differing by more luma levels aren't similar */
+static const unsigned kMaxMeanLumaChange = 8;
+
+// FNV-1a over 64-bit words, entropy-coded data is hashed in full for every frame.
+static uint64_t
+hash_data(const unsigned char* data, size_t size)
+{
+    uint64_t hash = kFNVOffsetBasis;
+
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        hash = (hash ^ word) * kFNVPrime;
+        data += sizeof(word);
+    }
+
+    for (; size > 0; size--) {
+        hash = (hash ^ *data++) * kFNVPrime;
+    }
+
+    return hash;
+}
+
+static uint64_t
+average_hash(const std::vector<uint8_t>& image, unsigned width, unsigned height, unsigned& mean_luma)
+{
+    uint32_t cells[kHashGrid * kHashGrid];
+    uint64_t total = 0;
+
+    for (unsigned cy = 0; cy < kHashGrid; cy++) {
+        unsigned y0 = cy * height / kHashGrid;
+        unsigned y1 = std::max(y0 + 1, (cy + 1) * height / kHashGrid);
+
+        for (unsigned cx = 0; cx < kHashGrid; cx++) {
+            unsigned x0 = cx * width / kHashGrid;
+            unsigned x1 = std::max(x0 + 1, (cx + 1) * width / kHashGrid);
+            uint32_t sum = 0;
+
+            for (unsigned y = y0; y < y1 and y < height; y++) {
+                for (unsigned x = x0; x < x1 and x < width; x++) {
+                    sum += image[y * width + x];
+                }
+            }
+
+            // cells are compared as averages, scale sums to a common area
+            cells[cy * kHashGrid + cx] = sum * kHashGrid * kHashGrid / ((y1 - y0) * (x1 - x0));
+            total += cells[cy * kHashGrid + cx];
+        }
+    }
+
+    uint64_t mean = total / (kHashGrid * kHashGrid);
+    mean_luma = mean / (kHashGrid * kHashGrid);
+    uint64_t hash = 0;
+
+    for (unsigned i = 0; i < kHashGrid * kHashGrid; i++) {
+        hash = (hash << 1) | (cells[i] > mean ? 1 : 0);
+    }
+
+    return hash;
+}
+
+DuplicateFilter::DuplicateFilter(int max_distance)
+    : distance(max_distance)
+{
+}
+
+DuplicateFilter::Result
+DuplicateFilter::check_exact(const unsigned char* scan, size_t size)
+{
+    auto hash = hash_data(scan, size);
+
+    if (has_last_hash and hash == last_hash) {
+        return Exact;
+    }
+
+    last_hash = hash;
+    has_last_hash = true;
+
+    return Unique;
+}
+
+DuplicateFilter::Result
+DuplicateFilter::check_similar(const std::vector<uint8_t>& dc_image, unsigned width, unsigned height)
+{
+    if (distance < 0 or dc_image.empty()) {
+        return Unique;
+    }
+
+    unsigned luma;
+    auto hash = average_hash(dc_image, width, height, luma);
+    auto luma_change = luma > stored_luma ? luma - stored_luma : stored_luma - luma;
+
+    if (has_stored_hash and __builtin_popcountll(hash ^ stored_hash) <= distance and luma_change <= kMaxMeanLumaChange) {
+        return Similar;
+    }
+
+    stored_hash = hash;
+    stored_luma = luma;
+    has_stored_hash = true;
+
+    return Unique;
+}
@@ -0,0 +1,41 @@
+#ifndef UVCCAPTURE2_DUPLICATE_FILTER_HPP
+#define UVCCAPTURE2_DUPLICATE_FILTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+static const int kDefaultDuplicateDistance = 2;
+
+// Recognizes repeated frames. Exact repeats of the previous frame (a stalled
+// sensor) are found by a hash of the entropy-coded data. Frames nearly
+// identical to the last stored one (a static scene) are found by the Hamming
+// distance between 64-bit average hashes of DC images (see DCTAnalyzer): the
+// image is split into 8x8 cells and every cell gives a bit telling whether
+// it's brighter than the whole image. Mean brightness has to match as well.
+class DuplicateFilter
+{
+public:
+    enum Result { Unique, Exact, Similar };
+
+    DuplicateFilter(const DuplicateFilter&) = delete;
+    // max_distance of -1 only recognizes exact repeats.
+    DuplicateFilter(int max_distance);
+
+    Result check_exact(const unsigned char* scan, size_t size);
+
+    // Is called for frames check_exact() has found unique, a Unique frame
+    // becomes the reference for the following ones.
+    Result check_similar(const std::vector<uint8_t>& dc_image, unsigned width, unsigned height);
+
+private:
+    int distance;
+
+    uint64_t last_hash = 0;
+    bool has_last_hash = false;
+    uint64_t stored_hash = 0;
+    unsigned stored_luma = 0;
+    bool has_stored_hash = false;
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include <linux/limits.h>
+
+#include <cstring>
+
+#include "file_name_template.hpp"
+
+static const char kFieldStart = '%';
+
+static bool
+is_strftime_flag(char c)
+{
+    return c == '_' or c == '-' or c == '0' or c == '^' or c == '#';
+}
+
+bool
+FileNameTemplate::parse(const std::string& tmpl, bool expand_date, const std::string& device_path)
+{
+    segments.clear();
+    has_date = false;
+    cached_second = -1;
+
+    auto slash = device_path.rfind('/');
+    auto device_name = slash == std::string::npos ? device_path : device_path.substr(slash + 1);
+
+    size_t pos = 0;
+    while (pos < tmpl.size()) {
+        auto next = tmpl.find(kFieldStart, pos);
+        if (next == std::string::npos) {
+            append_literal(tmpl.substr(pos));
+            break;
+        }
+
+        if (next > pos) {
+            append_literal(tmpl.substr(pos, next - pos));
+        }
+
+        pos = next;
+        if (not parse_field(tmpl, pos, expand_date, device_name)) {
+            return false;
+        }
+    }
+
+    if (segments.empty()) {
+        error_message = "empty template";
+        return false;
+    }
+
+    return true;
+}
+
+bool
+FileNameTemplate::parse_field(const std::string& tmpl, size_t& pos, bool expand_date, const std::string& device_name)
+{
+    auto start = pos++;
+
+    if (pos < tmpl.size() and tmpl[pos] == kFieldStart) {
+        append_literal("%");
+        pos++;
+        return true;
+    }
+
+    Segment segment;
+
+    while (pos < tmpl.size() and (tmpl[pos] == '0' or tmpl[pos] == '-')) {
+        if (tmpl[pos] == '0') {
+            segment.zero_pad = true;
+        } else {
+            segment.left_align = true;
+        }
+        pos++;
+    }
+
+    while (pos < tmpl.size() and tmpl[pos] >= '0' and tmpl[pos] <= '9') {
+        segment.width = segment.width * 10 + (tmpl[pos] - '0');
+        if (segment.width >= PATH_MAX) {
+            error_message = "field width is too large at position " + std::to_string(start);
+            return false;
+        }
+        pos++;
+    }
+
+    if (pos >= tmpl.size()) {
+        error_message = "incomplete field at position " + std::to_string(start);
+        return false;
+    }
+
+    if (tmpl[pos] == '{') {
+        auto end = tmpl.find('}', pos);
+        if (end == std::string::npos) {
+            error_message = "unterminated field at position " + std::to_string(start);
+            return false;
+        }
+
+        auto name = tmpl.substr(pos + 1, end - pos - 1);
+        pos = end + 1;
+
+        if (name == "counter") {
+            segment.type = SegmentType::Counter;
+        } else if (name == "sequence") {
+            segment.type = SegmentType::Sequence;
+        } else if (name == "msec" or name == "usec") {
+            segment.type = name == "msec" ? SegmentType::Milliseconds : SegmentType::Microseconds;
+            if (segment.width == 0) {
+                segment.width = name == "msec" ? 3 : 6;
+                segment.zero_pad = true;
+            }
+        } else if (name == "device") {
+            append_literal(device_name);
+            return true;
+        } else {
+            error_message = "unknown field '" + name + "'";
+            return false;
+        }
+
+        segments.push_back(segment);
+        return true;
+    }
+
+    if (expand_date) {
+        // Hand the whole conversion over to strftime(), including glibc flags and E/O modifiers.
+        pos = start + 1;
+        while (pos < tmpl.size() and is_strftime_flag(tmpl[pos])) {
+            pos++;
+        }
+        while (pos < tmpl.size() and ((tmpl[pos] >= '0' and tmpl[pos] <= '9') or tmpl[pos] == 'E' or tmpl[pos] == 'O')) {
+            pos++;
+        }
+        if (pos >= tmpl.size()) {
+            error_message = "incomplete field at position " + std::to_string(start);
+            return false;
+        }
+        pos++;
+        append_date(tmpl.substr(start, pos - start));
+        return true;
+    }
+
+    auto conversion = tmpl[pos++];
+    if (conversion != 'd' and conversion != 'i' and conversion != 'u') {
+        error_message = std::string("unsupported conversion '%") + conversion + "' at position " + std::to_string(start);
+        return false;
+    }
+
+    segment.type = SegmentType::Counter;
+    segments.push_back(segment);
+
+    return true;
+}
+
+void
+FileNameTemplate::append_literal(const std::string& text)
+{
+    if (not segments.empty() and segments.back().type == SegmentType::Literal) {
+        segments.back().text += text;
+        return;
+    }
+
+    Segment segment;
+    segment.type = SegmentType::Literal;
+    segment.text = text;
+    segments.push_back(segment);
+}
+
+void
+FileNameTemplate::append_date(const std::string& text)
+{
+    has_date = true;
+
+    if (not segments.empty() and segments.back().type == SegmentType::Date) {
+        segments.back().text += text;
+        return;
+    }
+
+    Segment segment;
+    segment.type = SegmentType::Date;
+    segment.text = text;
+    segments.push_back(segment);
+}
+
+bool
+FileNameTemplate::update_date_cache(time_t second)
+{
+    struct tm lt;
+    if (localtime_r(&second, &lt) == nullptr) {
+        error_message = "localtime_r() failed";
+        return false;
+    }
+
+    char buffer[PATH_MAX];
+
+    for (auto& segment : segments) {
+        if (segment.type != SegmentType::Date) {
+            continue;
+        }
+
+        auto rc = strftime(buffer, sizeof(buffer), segment.text.c_str(), &lt);
+        if (rc == 0) {
+            error_message = "strftime() failed to expand '" + segment.text + "'";
+            return false;
+        }
+
+        segment.cached.assign(buffer, rc);
+    }
+
+    cached_second = second;
+
+    return true;
+}
+
+void
+FileNameTemplate::append_number(std::string& result, uint64_t value, const Segment& segment)
+{
+    char digits[20];
+    unsigned count = 0;
+
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    unsigned padding = segment.width > count ? segment.width - count : 0;
+
+    if (not segment.left_align) {
+        result.append(padding, segment.zero_pad ? '0' : ' ');
+    }
+
+    while (count > 0) {
+        result.push_back(digits[--count]);
+    }
+
+    if (segment.left_align) {
+        result.append(padding, ' ');
+    }
+}
+
+bool
+FileNameTemplate::render(uint64_t counter, uint32_t sequence, const struct timespec& timestamp, std::string& result)
+{
+    if (has_date and timestamp.tv_sec != cached_second) {
+        if (not update_date_cache(timestamp.tv_sec)) {
+            return false;
+        }
+    }
+
+    result.clear();
+
+    for (const auto& segment : segments) {
+        switch (segment.type) {
+        case SegmentType::Literal:
+            result += segment.text;
+            break;
+        case SegmentType::Date:
+            result += segment.cached;
+            break;
+        case SegmentType::Counter:
+            append_number(result, counter, segment);
+            break;
+        case SegmentType::Sequence:
+            append_number(result, sequence, segment);
+            break;
+        case SegmentType::Milliseconds:
+            append_number(result, timestamp.tv_nsec / 1000000, segment);
+            break;
+        case SegmentType::Microseconds:
+            append_number(result, timestamp.tv_nsec / 1000, segment);
+            break;
+        }
+    }
+
+    if (result.size() >= PATH_MAX) {
+        error_message = "file name is too long";
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef UVCCAPTURE2_FILE_NAME_TEMPLATE_HPP
+#define UVCCAPTURE2_FILE_NAME_TEMPLATE_HPP
+
+#include <time.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Result file name template which is parsed once and then rendered for every
+// frame without going through printf-like functions. Supported fields:
+//
+//   %d, %05d, %-5d, %i, %u - frame counter (printf-like flags and width)
+//   %{counter}             - frame counter
+//   %{sequence}            - V4L2 frame sequence number
+//   %{msec}, %{usec}       - sub-second part of the capture time
+//   %{device}              - camera's device name, e.g. video0
+//   %%                     - literal '%'
+//
+// Braced fields accept the same flags and width, e.g. %06{sequence}. With
+// expand_date every other conversion is passed to strftime(), its result is
+// cached for the current second.
+class FileNameTemplate
+{
+public:
+    bool parse(const std::string& tmpl, bool expand_date, const std::string& device_path);
+
+    // Renders the name into result, which is reused between calls to avoid allocations.
+    bool render(uint64_t counter, uint32_t sequence, const struct timespec& timestamp, std::string& result);
+
+    std::string
+    error() const
+    {
+        return error_message;
+    }
+
+private:
+    enum class SegmentType { Literal, Date, Counter, Sequence, Milliseconds, Microseconds };
+
+    struct Segment {
+        SegmentType type = SegmentType::Literal;
+        /* literal text or strftime() format for Date segments */
+        std::string text;
+        /* rendered Date segment for cached_second */
+        std::string cached;
+        unsigned width = 0;
+        bool zero_pad = false;
+        bool left_align = false;
+    };
+
+    std::vector<Segment> segments;
+    std::string error_message;
+
+    bool has_date = false;
+    time_t cached_second = -1;
+
+    void append_literal(const std::string& text);
+    void append_date(const std::string& text);
+    bool parse_field(const std::string& tmpl, size_t& pos, bool expand_date, const std::string& device_name);
+    bool update_date_cache(time_t second);
+
+    static void append_number(std::string& result, uint64_t value, const Segment& segment);
+};
+
+#endif
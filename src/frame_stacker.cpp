@@ -0,0 +1,135 @@
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "frame_stacker.hpp"
+
+static const int kMaxSample = 255;
+
+static void
+widen(const unsigned char* src, uint16_t* dst, size_t count)
+{
+    for (; count > 0; count--) {
+        *dst++ = *src++;
+    }
+}
+
+static void
+accumulate(const unsigned char* src, uint16_t* acc, size_t count)
+{
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; count >= 16; count -= 16) {
+        auto samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc));
+        auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + 8));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc), _mm_add_epi16(lo, _mm_unpacklo_epi8(samples, zero)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + 8), _mm_add_epi16(hi, _mm_unpackhi_epi8(samples, zero)));
+
+        src += 16;
+        acc += 16;
+    }
+#elif defined(__ARM_NEON)
+    for (; count >= 16; count -= 16) {
+        auto samples = vld1q_u8(src);
+
+        vst1q_u16(acc, vaddw_u8(vld1q_u16(acc), vget_low_u8(samples)));
+        vst1q_u16(acc + 8, vaddw_u8(vld1q_u16(acc + 8), vget_high_u8(samples)));
+
+        src += 16;
+        acc += 16;
+    }
+#endif
+
+    for (; count > 0; count--) {
+        *acc++ += *src++;
+    }
+}
+
+// Divides by the number of frames with rounding: (sum + n / 2) * ceil(65536 / n) >> 16,
+// which is off by at most one level for large stacks.
+static void
+divide(const uint16_t* acc, unsigned char* dst, size_t count, unsigned frames)
+{
+    const uint16_t half = frames / 2;
+    const uint16_t reciprocal = (65536 + frames - 1) / frames;
+
+#if defined(__SSE2__)
+    const __m128i halves = _mm_set1_epi16(static_cast<short>(half));
+    const __m128i multiplier = _mm_set1_epi16(static_cast<short>(reciprocal));
+
+    for (; count >= 16; count -= 16) {
+        auto lo = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc)), halves);
+        auto hi = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + 8)), halves);
+
+        auto result = _mm_packus_epi16(_mm_mulhi_epu16(lo, multiplier), _mm_mulhi_epu16(hi, multiplier));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), result);
+
+        acc += 16;
+        dst += 16;
+    }
+#elif defined(__ARM_NEON)
+    const uint16x8_t halves = vdupq_n_u16(half);
+    const uint16x4_t multiplier = vdup_n_u16(reciprocal);
+
+    for (; count >= 16; count -= 16) {
+        auto lo = vaddq_u16(vld1q_u16(acc), halves);
+        auto hi = vaddq_u16(vld1q_u16(acc + 8), halves);
+
+        auto lo_result = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(lo), multiplier), 16),
+            vshrn_n_u32(vmull_u16(vget_high_u16(lo), multiplier), 16));
+        auto hi_result = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(hi), multiplier), 16),
+            vshrn_n_u32(vmull_u16(vget_high_u16(hi), multiplier), 16));
+        vst1q_u8(dst, vcombine_u8(vqmovn_u16(lo_result), vqmovn_u16(hi_result)));
+
+        acc += 16;
+        dst += 16;
+    }
+#endif
+
+    for (; count > 0; count--) {
+        unsigned value = ((*acc++ + half) * reciprocal) >> 16;
+        *dst++ = std::min<unsigned>(value, kMaxSample);
+    }
+}
+
+FrameStacker::FrameStacker(unsigned stack_size)
+    : frames_count(std::min(std::max(stack_size, 1u), kMaxStackedFrames))
+{
+}
+
+bool
+FrameStacker::add(const unsigned char* samples, size_t count)
+{
+    if (frames == 0 or count != samples_count) {
+        if (accumulator.size() < count) {
+            accumulator.resize(count);
+        }
+        samples_count = count;
+        frames = 0;
+        widen(samples, accumulator.data(), count);
+    } else {
+        accumulate(samples, accumulator.data(), count);
+    }
+
+    return ++frames >= frames_count;
+}
+
+void
+FrameStacker::average(unsigned char* output)
+{
+    if (frames == 1) {
+        // the reciprocal of 1 doesn't fit 16 bits
+        std::copy(accumulator.begin(), accumulator.begin() + samples_count, output);
+    } else if (frames > 1) {
+        divide(accumulator.data(), output, samples_count, frames);
+    }
+
+    frames = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef UVCCAPTURE2_FRAME_STACKER_HPP
+#define UVCCAPTURE2_FRAME_STACKER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 16-bit accumulators hold up to 257 frames of 8-bit samples
+static const unsigned kMaxStackedFrames = 256;
+
+// Averages consecutive frames sample by sample to reduce sensor noise of a
+// static scene. Samples are summed into 16-bit accumulators with SSE2/NEON,
+// the accumulator buffer only grows, so a steady stream of frames doesn't
+// allocate.
+class FrameStacker
+{
+public:
+    FrameStacker(const FrameStacker&) = delete;
+    FrameStacker(unsigned stack_size);
+
+    // Adds a frame, a frame of another size starts a new stack. Returns true
+    // once the stack has got all of its frames.
+    bool add(const unsigned char* samples, size_t count);
+
+    // Writes the average of the stack into output, which has to have room for
+    // the added number of samples, and starts a new stack.
+    void average(unsigned char* output);
+
+private:
+    unsigned frames_count;
+    unsigned frames = 0;
+    size_t samples_count = 0;
+    std::vector<uint16_t> accumulator;
+};
+
+#endif
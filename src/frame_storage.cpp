@@ -0,0 +1,439 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "easylogging++/easylogging++.h"
+
+#include "frame_storage.hpp"
+
+static const size_t kMaxCachedDirectories = 8;
+static const mode_t kDirectoryMode = 0755;
+static const mode_t kFileMode = 0644;
+static const char* kTempSuffix = ".tmp";
+
+FrameStorage::Directory::Directory(const std::string& directory_path, int directory_fd, dev_t directory_device)
+    : path(directory_path)
+    , fd(directory_fd)
+    , device(directory_device)
+{
+}
+
+FrameStorage::Directory::~Directory()
+{
+    close(fd);
+}
+
+FrameStorage::~FrameStorage()
+{
+    flush();
+}
+
+bool
+FrameStorage::parse_shard_mode(const std::string& name, ShardMode& mode)
+{
+    if (name == "none") {
+        mode = ShardMode::None;
+    } else if (name == "day") {
+        mode = ShardMode::Day;
+    } else if (name == "hour") {
+        mode = ShardMode::Hour;
+    } else if (name == "counter") {
+        mode = ShardMode::Counter;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+bool
+FrameStorage::parse_durability_mode(const std::string& name, DurabilityMode& mode)
+{
+    if (name == "none") {
+        mode = DurabilityMode::None;
+    } else if (name == "frame") {
+        mode = DurabilityMode::Frame;
+    } else if (name == "group") {
+        mode = DurabilityMode::Group;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+bool
+FrameStorage::configure(ShardMode mode, unsigned shard_size)
+{
+    if (shard_size == 0) {
+        LOG(ERROR) << "shard size has to be positive";
+        return false;
+    }
+
+    shard_mode = mode;
+    shard_bucket_size = shard_size;
+
+    return true;
+}
+
+bool
+FrameStorage::configure_durability(DurabilityMode mode, unsigned sync_frames, unsigned sync_interval_ms)
+{
+    if (sync_frames == 0 or sync_interval_ms == 0) {
+        LOG(ERROR) << "group commit size and interval have to be positive";
+        return false;
+    }
+
+    durability = mode;
+    group_size = sync_frames;
+    group_interval = std::chrono::milliseconds(sync_interval_ms);
+
+    if (durability == DurabilityMode::Group and not committer.joinable()) {
+        committer = std::thread(&FrameStorage::commit_loop, this);
+    }
+
+    return true;
+}
+
+bool
+FrameStorage::flush()
+{
+    if (committer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            stopping = true;
+        }
+        pending_cv.notify_one();
+        committer.join();
+    }
+
+    return not commit_failed;
+}
+
+bool
+FrameStorage::make_directory_path(const std::string& file_name, size_t name_start, uint64_t counter, const struct timespec& timestamp)
+{
+    directory_path.assign(file_name, 0, name_start);
+
+    switch (shard_mode) {
+    case ShardMode::None:
+        break;
+    case ShardMode::Day:
+    case ShardMode::Hour:
+        if (timestamp.tv_sec != shard_second) {
+            struct tm lt;
+            if (localtime_r(&timestamp.tv_sec, &lt) == nullptr) {
+                LOG(ERROR) << "localtime_r() failed";
+                return false;
+            }
+
+            char date[32];
+            auto rc = strftime(date, sizeof(date), shard_mode == ShardMode::Day ? "%Y-%m-%d" : "%Y-%m-%d/%H", &lt);
+            if (rc == 0) {
+                LOG(ERROR) << "strftime() failed";
+                return false;
+            }
+
+            shard_date.assign(date, rc);
+            shard_second = timestamp.tv_sec;
+        }
+        directory_path += shard_date;
+        break;
+    case ShardMode::Counter: {
+        auto bucket = std::to_string(counter / shard_bucket_size);
+        if (bucket.size() < 6) {
+            directory_path.append(6 - bucket.size(), '0');
+        }
+        directory_path += bucket;
+        break;
+    }
+    }
+
+    if (directory_path.empty()) {
+        directory_path = ".";
+    } else if (directory_path.size() > 1 and directory_path.back() == '/') {
+        directory_path.pop_back();
+    }
+
+    return true;
+}
+
+bool
+FrameStorage::make_directories(const std::string& path)
+{
+    size_t pos = 0;
+
+    while (pos != std::string::npos) {
+        pos = path.find('/', pos + 1);
+        auto prefix = path.substr(0, pos);
+
+        if (mkdir(prefix.c_str(), kDirectoryMode) < 0 and errno != EEXIST) {
+            LOG(ERROR) << "couldn't create directory '" << prefix << "': " << strerror(errno);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+FrameStorage::free_space(double& percent)
+{
+    if (directories.empty()) {
+        return false;
+    }
+
+    struct statvfs st;
+    if (fstatvfs(directories.back()->fd, &st) < 0) {
+        LOG(ERROR) << "fstatvfs() failed for '" << directories.back()->path << "': " << strerror(errno);
+        return false;
+    }
+
+    if (st.f_blocks == 0) {
+        return false;
+    }
+
+    percent = 100.0 * st.f_bavail / st.f_blocks;
+
+    return true;
+}
+
+FrameStorage::DirectoryPtr
+FrameStorage::directory(const std::string& path)
+{
+    for (size_t i = directories.size(); i > 0; i--) {
+        if (directories[i - 1]->path == path) {
+            if (i != directories.size()) {
+                std::swap(directories[i - 1], directories.back());
+            }
+            return directories.back();
+        }
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 and errno == ENOENT and shard_mode != ShardMode::None) {
+        if (make_directories(path)) {
+            fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+    }
+
+    if (fd < 0) {
+        LOG(ERROR) << "can't open directory '" << path << "': " << strerror(errno);
+        return DirectoryPtr();
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        LOG(ERROR) << "fstat() failed for '" << path << "': " << strerror(errno);
+        close(fd);
+        return DirectoryPtr();
+    }
+
+    if (directories.size() >= kMaxCachedDirectories) {
+        directories.erase(directories.begin());
+    }
+
+    directories.push_back(std::make_shared<Directory>(path, fd, st.st_dev));
+
+    return directories.back();
+}
+
+bool
+FrameStorage::write(const std::string& file_name, uint64_t counter, const struct timespec& timestamp, const unsigned char* data, size_t size)
+{
+    auto slash = file_name.rfind('/');
+    size_t name_start = slash == std::string::npos ? 0 : slash + 1;
+
+    if (name_start >= file_name.size()) {
+        LOG(ERROR) << "result file name '" << file_name << "' has no file part";
+        return false;
+    }
+
+    if (not make_directory_path(file_name, name_start, counter, timestamp)) {
+        return false;
+    }
+
+    auto name = file_name.c_str() + name_start;
+    auto target = name;
+
+    if (durability != DurabilityMode::None) {
+        // a sequence number keeps temporary names unique even if the same
+        // final name is written again before the previous file was committed
+        temp_name.assign(".");
+        temp_name.append(name);
+        temp_name.append(".");
+        temp_name.append(std::to_string(temp_sequence++));
+        temp_name.append(kTempSuffix);
+        target = temp_name.c_str();
+    }
+
+    DirectoryPtr dir;
+    int fd = -1;
+
+    for (int attempt = 0; attempt < 2 and fd < 0; attempt++) {
+        dir = directory(directory_path);
+        if (not dir) {
+            return false;
+        }
+
+        fd = openat(dir->fd, target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, kFileMode);
+        if (fd < 0 and errno == ENOENT) {
+            // directory has been removed behind our back, reopen it
+            directories.pop_back();
+        }
+    }
+
+    if (fd < 0) {
+        LOG(ERROR) << "can't open '" << file_name << "': " << strerror(errno);
+        return false;
+    }
+
+    if (not write_file(fd, file_name, data, size)) {
+        close(fd);
+        unlinkat(dir->fd, target, 0);
+        return false;
+    }
+
+    if (durability == DurabilityMode::Frame and fdatasync(fd) < 0) {
+        LOG(ERROR) << "fdatasync() failed for '" << file_name << "': " << strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    if (close(fd) < 0) {
+        LOG(ERROR) << "close file failed: " << strerror(errno);
+        return false;
+    }
+
+    if (durability == DurabilityMode::Frame) {
+        if (renameat(dir->fd, target, dir->fd, name) < 0) {
+            LOG(ERROR) << "can't rename '" << target << "' to '" << file_name << "': " << strerror(errno);
+            return false;
+        }
+        if (fsync(dir->fd) < 0) {
+            LOG(ERROR) << "fsync() failed for '" << dir->path << "': " << strerror(errno);
+            return false;
+        }
+    } else if (durability == DurabilityMode::Group) {
+        PendingFile file;
+        file.directory = dir;
+        file.temp_name = temp_name;
+        file.name = name;
+
+        bool notify = false;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            if (commit_failed) {
+                LOG(ERROR) << "committing result files to disk has failed";
+                return false;
+            }
+            pending.push_back(std::move(file));
+            notify = pending.size() >= group_size;
+        }
+
+        if (notify) {
+            pending_cv.notify_one();
+        }
+    }
+
+    return true;
+}
+
+bool
+FrameStorage::write_file(int fd, const std::string& file_name, const unsigned char* data, size_t size)
+{
+    while (size > 0) {
+        auto written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG(ERROR) << "write file '" << file_name << "' failed: " << strerror(errno);
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+void
+FrameStorage::commit_loop()
+{
+    std::unique_lock<std::mutex> lock(pending_mutex);
+    std::vector<PendingFile> files;
+
+    while (true) {
+        pending_cv.wait_for(lock, group_interval, [this] { return stopping or pending.size() >= group_size; });
+
+        if (pending.empty()) {
+            if (stopping) {
+                break;
+            }
+            continue;
+        }
+
+        files.clear();
+        files.swap(pending);
+
+        lock.unlock();
+        auto ok = commit(files);
+        lock.lock();
+
+        if (not ok) {
+            commit_failed = true;
+        }
+    }
+}
+
+bool
+FrameStorage::commit(std::vector<PendingFile>& files)
+{
+    std::vector<dev_t> synced_devices;
+    std::vector<Directory*> synced;
+    bool ok = true;
+
+    // One syncfs() per filesystem flushes data of the whole batch, only then
+    // the files get their final names.
+    for (const auto& file : files) {
+        auto dir = file.directory.get();
+        if (std::find(synced.begin(), synced.end(), dir) != synced.end()) {
+            continue;
+        }
+        synced.push_back(dir);
+
+        if (std::find(synced_devices.begin(), synced_devices.end(), dir->device) != synced_devices.end()) {
+            continue;
+        }
+        if (syncfs(dir->fd) < 0) {
+            LOG(ERROR) << "syncfs() failed for '" << dir->path << "': " << strerror(errno);
+            return false;
+        }
+        synced_devices.push_back(dir->device);
+    }
+
+    for (const auto& file : files) {
+        auto dir = file.directory->fd;
+        if (renameat(dir, file.temp_name.c_str(), dir, file.name.c_str()) < 0) {
+            LOG(ERROR) << "can't rename '" << file.temp_name << "' in '" << file.directory->path << "': " << strerror(errno);
+            ok = false;
+        }
+    }
+
+    for (auto dir : synced) {
+        if (fsync(dir->fd) < 0) {
+            LOG(ERROR) << "fsync() failed for '" << dir->path << "': " << strerror(errno);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
@@ -0,0 +1,126 @@
+#ifndef UVCCAPTURE2_FRAME_STORAGE_HPP
+#define UVCCAPTURE2_FRAME_STORAGE_HPP
+
+#include <time.h>
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class ShardMode {
+    None,
+    Day, /* <dir>/YYYY-MM-DD/<name> */
+    Hour, /* <dir>/YYYY-MM-DD/HH/<name> */
+    Counter /* <dir>/<counter / bucket size>/<name> */
+};
+
+enum class DurabilityMode {
+    None, /* leave it to the kernel, files are written in place */
+    Frame, /* every file is synced before it becomes visible */
+    Group /* files become visible in batches, one filesystem sync per batch */
+};
+
+// Measured with tests/shard_benchmark.cpp on ext4, one million files: listing
+// a directory with stat() of every entry takes ~1.3 s flat and 10-40 ms for a
+// shard of ten thousand, the file creation rate is the same either way within
+// the run-to-run noise. That keeps shards cheap for ls, rsync and cleanup
+// scripts without creating a directory every few seconds.
+static const unsigned kDefaultShardSize = 10000;
+static const unsigned kDefaultSyncFrames = 100;
+static const unsigned kDefaultSyncIntervalMs = 1000;
+
+// Writes result files. Directories are opened once and kept open, files are
+// created relative to them with openat() so path lookups don't grow with the
+// capture length. With sharding enabled files are spread over subdirectories
+// which are created on demand.
+//
+// With durability enabled a file is written under a temporary name and renamed
+// only after its data reached the disk, so a power cut never leaves a partially
+// written image under its final name. In group mode a background thread commits
+// pending files every sync_frames files or sync_interval, whatever comes first.
+class FrameStorage
+{
+public:
+    FrameStorage(const FrameStorage&) = delete;
+    FrameStorage() = default;
+
+    ~FrameStorage();
+
+    bool configure(ShardMode mode, unsigned shard_size);
+
+    bool configure_durability(DurabilityMode mode, unsigned sync_frames, unsigned sync_interval_ms);
+
+    bool write(const std::string& file_name, uint64_t counter, const struct timespec& timestamp, const unsigned char* data, size_t size);
+
+    // Free space (in percents) on the filesystem files were last written to.
+    bool free_space(double& percent);
+
+    // Commits all pending files and stops the background thread.
+    bool flush();
+
+    static bool parse_shard_mode(const std::string& name, ShardMode& mode);
+    static bool parse_durability_mode(const std::string& name, DurabilityMode& mode);
+
+private:
+    struct Directory {
+        Directory(const Directory&) = delete;
+        Directory(const std::string& directory_path, int directory_fd, dev_t directory_device);
+        ~Directory();
+
+        std::string path;
+        int fd;
+        /* filesystem the directory belongs to */
+        dev_t device;
+    };
+
+    using DirectoryPtr = std::shared_ptr<Directory>;
+
+    struct PendingFile {
+        DirectoryPtr directory;
+        std::string temp_name;
+        std::string name;
+    };
+
+    ShardMode shard_mode = ShardMode::None;
+    unsigned shard_bucket_size = kDefaultShardSize;
+
+    /* most recently used directory goes last */
+    std::vector<DirectoryPtr> directories;
+
+    time_t shard_second = -1;
+    std::string shard_date;
+    std::string directory_path;
+    std::string temp_name;
+    uint64_t temp_sequence = 0;
+
+    DurabilityMode durability = DurabilityMode::None;
+    unsigned group_size = kDefaultSyncFrames;
+    std::chrono::milliseconds group_interval = std::chrono::milliseconds(kDefaultSyncIntervalMs);
+
+    std::thread committer;
+    std::mutex pending_mutex;
+    std::condition_variable pending_cv;
+    std::vector<PendingFile> pending;
+    bool stopping = false;
+    bool commit_failed = false;
+
+    bool make_directory_path(const std::string& file_name, size_t name_start, uint64_t counter, const struct timespec& timestamp);
+    DirectoryPtr directory(const std::string& path);
+    bool make_directories(const std::string& path);
+
+    int create_file(const std::string& file_name, const char* name);
+    bool write_file(int fd, const std::string& file_name, const unsigned char* data, size_t size);
+
+    void commit_loop();
+    bool commit(std::vector<PendingFile>& files);
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <string>
+
+#include "easylogging++/easylogging++.h"
+
+#include "frame_synchronizer.hpp"
+
+// a stalled device must not make the others hold all of their buffers
+static const size_t kMaxQueuedFrames = 8;
+static const uint64_t kSkewBuckets[] = { 100, 500, 1000, 2000, 5000, 10000, 20000, 50000 };
+
+FrameSynchronizer::FrameSynchronizer(const std::vector<SynchronizedSource*>& frame_sources, uint64_t tolerance_us, Metrics& metrics_registry)
+    : sources(frame_sources)
+    , tolerance(tolerance_us)
+    , metrics(metrics_registry)
+    , queues(frame_sources.size())
+    , next_write(frame_sources.size(), 0)
+{
+}
+
+bool
+FrameSynchronizer::submit(size_t source, const struct v4l2_buffer& bufferinfo)
+{
+    std::vector<FrameSet> sets;
+
+    auto ok = match(source, bufferinfo, sets);
+
+    // matched sets are written even if dropping a frame failed, that gives their buffers back
+    for (const auto& set : sets) {
+        if (not write_set(set)) {
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+bool
+FrameSynchronizer::match(size_t source, const struct v4l2_buffer& bufferinfo, std::vector<FrameSet>& sets)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Frame frame;
+    frame.bufferinfo = bufferinfo;
+    frame.timestamp_us = static_cast<uint64_t>(bufferinfo.timestamp.tv_sec) * 1000000 + bufferinfo.timestamp.tv_usec;
+
+    queues[source].push_back(frame);
+    if (queues[source].size() > kMaxQueuedFrames and not drop_front(source)) {
+        return false;
+    }
+
+    while (true) {
+        size_t oldest = 0;
+        uint64_t min_timestamp = UINT64_MAX;
+        uint64_t max_timestamp = 0;
+
+        for (size_t i = 0; i < queues.size(); i++) {
+            if (queues[i].empty()) {
+                return true;
+            }
+
+            auto timestamp = queues[i].front().timestamp_us;
+            if (timestamp < min_timestamp) {
+                min_timestamp = timestamp;
+                oldest = i;
+            }
+            if (timestamp > max_timestamp) {
+                max_timestamp = timestamp;
+            }
+        }
+
+        auto skew = max_timestamp - min_timestamp;
+        if (skew <= tolerance) {
+            take_set(skew, sets);
+            continue;
+        }
+
+        // the oldest frame can't be matched by anything the other devices will produce
+        if (not drop_front(oldest)) {
+            return false;
+        }
+    }
+}
+
+bool
+FrameSynchronizer::drop_front(size_t source)
+{
+    auto index = queues[source].front().bufferinfo.index;
+    queues[source].pop_front();
+
+    metrics.increment("sync_frames_dropped");
+
+    return sources[source]->release_buffer(index);
+}
+
+void
+FrameSynchronizer::take_set(uint64_t skew, std::vector<FrameSet>& sets)
+{
+    FrameSet set;
+    set.counter = sets_count;
+    clock_gettime(CLOCK_REALTIME, &set.timestamp);
+
+    for (auto& queue : queues) {
+        set.frames.push_back(queue.front());
+        queue.pop_front();
+    }
+
+    sets.push_back(set);
+
+    sets_count++;
+    skew_sum += skew;
+    skew_min = std::min(skew_min, skew);
+    skew_max = std::max(skew_max, skew);
+
+    metrics.increment("sync_sets");
+
+    std::string bucket = "sync_skew_us_le_inf";
+    for (auto limit : kSkewBuckets) {
+        if (skew <= limit) {
+            bucket = "sync_skew_us_le_" + std::to_string(limit);
+            break;
+        }
+    }
+    metrics.increment(bucket);
+}
+
+bool
+FrameSynchronizer::write_set(const FrameSet& set)
+{
+    bool ok = true;
+
+    for (size_t i = 0; i < set.frames.size(); i++) {
+        const auto& frame = set.frames[i];
+
+        // A source's encoder state isn't shared, and a later set must not
+        // overwrite files of an earlier one, so wait for the previous set.
+        std::unique_lock<std::mutex> lock(write_mutex);
+        write_cv.wait(lock, [&] { return next_write[i] == set.counter; });
+        lock.unlock();
+
+        if (not sources[i]->write_synchronized(frame.bufferinfo, set.counter, set.timestamp)) {
+            ok = false;
+        }
+        if (not sources[i]->release_buffer(frame.bufferinfo.index)) {
+            ok = false;
+        }
+
+        lock.lock();
+        next_write[i]++;
+        lock.unlock();
+        write_cv.notify_all();
+    }
+
+    return ok;
+}
+
+void
+FrameSynchronizer::report()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (sets_count == 0) {
+        LOG(INFO) << "no synchronized sets were captured";
+        return;
+    }
+
+    LOG(INFO) << "synchronized sets: " << sets_count << ", skew min/avg/max: " << skew_min << "/" << skew_sum / sets_count << "/"
+              << skew_max << " us";
+}
@@ -0,0 +1,86 @@
+#ifndef UVCCAPTURE2_FRAME_SYNCHRONIZER_HPP
+#define UVCCAPTURE2_FRAME_SYNCHRONIZER_HPP
+
+#include <time.h>
+
+#include <linux/videodev2.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "metrics.hpp"
+
+// Device side of FrameSynchronizer.
+class SynchronizedSource
+{
+public:
+    virtual ~SynchronizedSource() = default;
+
+    // Writes the frame as a member of a set, all frames of a set share counter and timestamp.
+    virtual bool write_synchronized(const struct v4l2_buffer& bufferinfo, uint64_t counter, const struct timespec& timestamp) = 0;
+
+    // Gives the frame's buffer back to the driver.
+    virtual bool release_buffer(uint32_t index) = 0;
+};
+
+// Matches frames of several devices by their V4L2 capture timestamps. As soon
+// as every device has a frame and all of them were captured within the tolerance
+// window, they are written as a set; frames which can't be matched anymore are
+// dropped. Skew of every set (the newest minus the oldest timestamp) is collected
+// into a histogram.
+//
+// Sets are matched under a lock, but written by the submitting thread after it's
+// released, so workers of other devices aren't blocked by encoding and file I/O.
+// Frames of one device are still written one at a time and in set order.
+class FrameSynchronizer
+{
+public:
+    FrameSynchronizer(const FrameSynchronizer&) = delete;
+    FrameSynchronizer(const std::vector<SynchronizedSource*>& frame_sources, uint64_t tolerance_us, Metrics& metrics_registry);
+
+    // Takes ownership of the buffer, it's released back to the source once the
+    // frame is written or dropped. May be called from several threads.
+    bool submit(size_t source, const struct v4l2_buffer& bufferinfo);
+
+    void report();
+
+private:
+    struct Frame {
+        struct v4l2_buffer bufferinfo;
+        uint64_t timestamp_us;
+    };
+
+    struct FrameSet {
+        uint64_t counter;
+        struct timespec timestamp;
+        /* a frame of every source, in the order of sources */
+        std::vector<Frame> frames;
+    };
+
+    std::vector<SynchronizedSource*> sources;
+    uint64_t tolerance;
+    Metrics& metrics;
+
+    std::mutex mutex;
+    std::vector<std::deque<Frame>> queues;
+
+    uint64_t sets_count = 0;
+    uint64_t skew_sum = 0;
+    uint64_t skew_min = UINT64_MAX;
+    uint64_t skew_max = 0;
+
+    std::mutex write_mutex;
+    std::condition_variable write_cv;
+    /* counter of the set every source writes next */
+    std::vector<uint64_t> next_write;
+
+    bool match(size_t source, const struct v4l2_buffer& bufferinfo, std::vector<FrameSet>& sets);
+    bool drop_front(size_t source);
+    void take_set(uint64_t skew, std::vector<FrameSet>& sets);
+    bool write_set(const FrameSet& set);
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "jpeg_codec.hpp"
+
+#include "easylogging++/easylogging++.h"
+
+#include "libjpeg_codec.hpp"
+#ifdef HAVE_TURBOJPEG
+#include "turbojpeg_codec.hpp"
+#endif
+
+bool
+parse_codec_profile(const std::string& name, CodecProfile& profile)
+{
+    if (name == "fastest") {
+        profile = kFastestProfile;
+    } else if (name == "balanced") {
+        profile = kBalancedProfile;
+    } else if (name == "best") {
+        profile = kBestProfile;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+CodecProfile
+rtp_codec_profile(const CodecProfile& profile)
+{
+    auto adjusted = profile;
+    adjusted.optimize_coding = false;
+
+    return adjusted;
+}
+
+JPEGCodecPtr
+create_jpeg_codec(const std::string& name, const CodecSettings& settings)
+{
+    if (name == "libjpeg") {
+        return JPEGCodecPtr(new LibJPEGCodec(settings));
+    }
+
+    if (name != "turbojpeg") {
+        LOG(ERROR) << "invalid value for '--codec' parameter: " << name;
+        return nullptr;
+    }
+
+#ifdef HAVE_TURBOJPEG
+    if (settings.strips > 1) {
+        LOG(ERROR) << "'--encoder-strips' isn't supported by TurboJPEG codec";
+        return nullptr;
+    }
+
+    std::unique_ptr<TurboJPEGCodec> codec(new TurboJPEGCodec(settings));
+    if (not codec->init()) {
+        return nullptr;
+    }
+
+    return JPEGCodecPtr(codec.release());
+#else
+    LOG(ERROR) << "uvccapture2 was built without TurboJPEG support";
+    return nullptr;
+#endif
+}
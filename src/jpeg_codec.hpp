@@ -0,0 +1,101 @@
+#ifndef UVCCAPTURE2_JPEG_CODEC_HPP
+#define UVCCAPTURE2_JPEG_CODEC_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "ycbcr_image.hpp"
+
+// Codec settings which trade quality for speed, selected with --speed.
+struct CodecProfile {
+    J_DCT_METHOD dct_method;
+    /* decoder: interpolate chroma instead of replicating samples */
+    bool fancy_upsampling;
+    /* decoder: smooth blocks of progressive images */
+    bool block_smoothing;
+    /* encoder: compute optimal Huffman tables, costs an extra pass */
+    bool optimize_coding;
+};
+
+static const CodecProfile kFastestProfile = { JDCT_IFAST, false, false, false };
+static const CodecProfile kBalancedProfile = { JDCT_ISLOW, true, true, false };
+static const CodecProfile kBestProfile = { JDCT_ISLOW, true, true, true };
+
+bool parse_codec_profile(const std::string& name, CodecProfile& profile);
+
+// The profile adjusted for RTP/JPEG receivers, which always use the standard
+// Huffman tables: optimized ones can't be sent.
+CodecProfile rtp_codec_profile(const CodecProfile& profile);
+
+struct CodecSettings {
+    CodecProfile profile = kBalancedProfile;
+    /* more than one splits every frame into strips encoded in parallel */
+    unsigned strips = 1;
+    /* don't report warnings about damaged frames */
+    bool quiet = false;
+};
+
+// Interleaved RGB, 3 bytes per pixel.
+class RGBImage
+{
+public:
+    // Returns true if the buffer had to be reallocated, its contents are not preserved.
+    bool
+    reserve(size_t size)
+    {
+        if (size <= capacity) {
+            return false;
+        }
+
+        raw_data = std::unique_ptr<unsigned char[]>(new unsigned char[size]);
+        capacity = size;
+
+        return true;
+    }
+
+    std::unique_ptr<unsigned char[]> raw_data;
+    size_t capacity = 0;
+
+    unsigned int width = 0;
+    unsigned int height = 0;
+};
+
+// Decoder and encoder of frames, implemented by the libjpeg and the TurboJPEG
+// backends. Failures are logged by the backend.
+class JPEGCodec
+{
+public:
+    virtual ~JPEGCodec() = default;
+
+    // Decodes a JPEG scaled down by scale_denom.
+    virtual bool decompress(const unsigned char* data, size_t size, unsigned scale_denom, RGBImage& image) = 0;
+
+    // Encodes with 4:2:0 chroma subsampling, same as jpeg_set_defaults().
+    virtual bool compress(const RGBImage& image, int quality, std::vector<unsigned char>& output) = 0;
+
+    // Encodes with the chroma subsampling of the image.
+    virtual bool compress(const YCbCrImage& image, int quality, std::vector<unsigned char>& output) = 0;
+
+    // Decodes a JPEG (scaled down by scale_denom) and encodes it again. With
+    // keep_ycbcr the image stays in planar YCbCr with its original chroma
+    // subsampling when the backend can do it, otherwise it goes through RGB.
+    virtual bool recompress(const unsigned char* data, size_t size, int quality, unsigned scale_denom, bool keep_ycbcr,
+        std::vector<unsigned char>& output) = 0;
+
+    // Sizes decode buffers for frames of the negotiated format, so that the
+    // steady state doesn't allocate.
+    virtual void reserve(unsigned width, unsigned height) = 0;
+};
+
+using JPEGCodecPtr = std::unique_ptr<JPEGCodec>;
+
+// Creates the backend named by --codec, libjpeg or turbojpeg. Returns nullptr
+// if the name is unknown or the backend can't work with the settings.
+JPEGCodecPtr create_jpeg_codec(const std::string& name, const CodecSettings& settings);
+
+#endif
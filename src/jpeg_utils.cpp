@@ -0,0 +1,576 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+#include "jpeg_utils.hpp"
+
+static const unsigned char kMarkerPrefix = 0xFF;
+static const unsigned char kMarkerSOI = 0xD8;
+static const unsigned char kMarkerEOI = 0xD9;
+static const unsigned char kMarkerSOS = 0xDA;
+static const unsigned char kMarkerDQT = 0xDB;
+static const unsigned char kMarkerDRI = 0xDD;
+static const unsigned char kMarkerDHT = 0xC4;
+static const unsigned char kMarkerJPG = 0xC8;
+static const unsigned char kMarkerDAC = 0xCC;
+static const unsigned char kMarkerTEM = 0x01;
+static const unsigned char kMarkerRST0 = 0xD0;
+static const unsigned char kMarkerRST7 = 0xD7;
+static const unsigned char kMarkerSOF0 = 0xC0;
+static const unsigned char kMarkerSOF1 = 0xC1;
+static const int kRestartMarkersCount = 8;
+static const unsigned kMaxSamplingFactor = 4;
+
+// DHT segment with the tables from ITU T.81, K.3: DC luminance, DC chrominance,
+// AC luminance and AC chrominance. Every table is the class/id byte, counts of
+// codes of lengths 1-16 and the symbols.
+static const unsigned char kStandardHuffmanTables[] = {
+    0xFF, 0xC4, 0x01, 0xA2,
+    /* DC luminance */
+    0x00,
+    0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+    /* DC chrominance */
+    0x01,
+    0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+    /* AC luminance */
+    0x10,
+    0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7D,
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+    0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+    0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA,
+    /* AC chrominance */
+    0x11,
+    0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77,
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+    0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+    0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+    0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+    0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+    0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA,
+};
+
+// Luminance quantization table of ITU T.81, K.1 in zigzag order, libjpeg
+// scales it by jpeg_quality_scaling() for quality settings other than 50.
+static const uint16_t kStandardLuminanceQuantTable[kJPEGQuantTableSize] = {
+    16, 11, 12, 14, 12, 10, 16, 14, 13, 14, 18, 17, 16, 19, 24, 40,
+    26, 24, 22, 22, 24, 49, 35, 37, 29, 40, 58, 51, 61, 60, 57, 51,
+    56, 55, 64, 72, 92, 78, 64, 68, 87, 69, 55, 56, 80, 109, 81, 87,
+    95, 98, 103, 104, 103, 62, 77, 113, 121, 112, 100, 120, 92, 101, 103, 99,
+};
+
+static const int kMaxQuality = 100;
+static const uint64_t kFNVOffsetBasis = 14695981039346656037ULL;
+static const uint64_t kFNVPrime = 1099511628211ULL;
+
+static inline uint16_t
+read_u16(const unsigned char* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static bool
+is_sof_marker(unsigned char marker)
+{
+    return marker >= 0xC0 and marker <= 0xCF and marker != kMarkerDHT and marker != kMarkerJPG and marker != kMarkerDAC;
+}
+
+static bool
+parse_dqt(const unsigned char* segment, size_t length, JPEGInfo& info)
+{
+    size_t pos = 0;
+
+    while (pos < length) {
+        uint8_t precision = segment[pos] >> 4;
+        uint8_t table_id = segment[pos] & 0x0F;
+        pos++;
+
+        if (table_id >= kJPEGMaxQuantTables or precision > 1) {
+            return false;
+        }
+
+        size_t table_size = kJPEGQuantTableSize * (precision + 1);
+        if (pos + table_size > length) {
+            return false;
+        }
+
+        auto& table = info.quant_tables[table_id];
+        table.present = true;
+        table.precision = precision;
+        for (int i = 0; i < kJPEGQuantTableSize; i++) {
+            table.values[i] = precision ? read_u16(segment + pos + i * 2) : segment[pos + i];
+        }
+
+        pos += table_size;
+    }
+
+    return true;
+}
+
+static size_t
+huffman_table_size(const unsigned char* table)
+{
+    size_t symbols = 0;
+    for (int i = 1; i <= 16; i++) {
+        symbols += table[i];
+    }
+
+    return 1 + 16 + symbols;
+}
+
+static bool
+is_standard_huffman_table(const unsigned char* table, size_t size)
+{
+    size_t pos = 4;
+
+    while (pos < sizeof(kStandardHuffmanTables)) {
+        const unsigned char* standard = kStandardHuffmanTables + pos;
+        size_t standard_size = huffman_table_size(standard);
+
+        if (standard[0] == table[0]) {
+            return standard_size == size and std::memcmp(standard, table, size) == 0;
+        }
+
+        pos += standard_size;
+    }
+
+    return false;
+}
+
+static bool
+parse_dht(const unsigned char* segment, size_t length, JPEGInfo& info)
+{
+    size_t pos = 0;
+
+    while (pos < length) {
+        if (pos + 1 + 16 > length) {
+            return false;
+        }
+
+        size_t table_size = huffman_table_size(segment + pos);
+        if (pos + table_size > length) {
+            return false;
+        }
+
+        if (not is_standard_huffman_table(segment + pos, table_size)) {
+            info.standard_huffman_tables = false;
+        }
+
+        pos += table_size;
+    }
+
+    info.has_dht = true;
+
+    return true;
+}
+
+static bool
+parse_sof(const unsigned char* segment, size_t length, unsigned char marker, JPEGInfo& info)
+{
+    if (length < 6) {
+        return false;
+    }
+
+    info.sof_marker = marker;
+    info.height = read_u16(segment + 1);
+    info.width = read_u16(segment + 3);
+    info.components_count = segment[5];
+
+    if (info.components_count < 1 or info.components_count > kJPEGMaxComponents) {
+        return false;
+    }
+
+    if (length < 6 + static_cast<size_t>(info.components_count) * 3) {
+        return false;
+    }
+
+    for (int i = 0; i < info.components_count; i++) {
+        const unsigned char* c = segment + 6 + i * 3;
+        info.components[i].id = c[0];
+        info.components[i].h_sampling = c[1] >> 4;
+        info.components[i].v_sampling = c[1] & 0x0F;
+        info.components[i].quant_table = c[2];
+
+        if (info.components[i].quant_table >= kJPEGMaxQuantTables) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+find_eoi(const unsigned char* data, size_t from, size_t size, size_t& eoi)
+{
+    // UVC cameras often leave padding after the EOI marker, so search backwards.
+    for (size_t i = size; i >= from + 2; i--) {
+        if (data[i - 2] == kMarkerPrefix and data[i - 1] == kMarkerEOI) {
+            eoi = i - 2;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+parse_jpeg_header(const unsigned char* data, size_t size, JPEGInfo& info)
+{
+    info = JPEGInfo();
+
+    if (size < 4 or data[0] != kMarkerPrefix or data[1] != kMarkerSOI) {
+        return false;
+    }
+
+    size_t pos = 2;
+
+    while (pos < size) {
+        if (data[pos] != kMarkerPrefix) {
+            return false;
+        }
+
+        // skip optional fill bytes
+        while (pos < size and data[pos] == kMarkerPrefix) {
+            pos++;
+        }
+
+        if (pos >= size) {
+            return false;
+        }
+
+        unsigned char marker = data[pos++];
+
+        if (marker == kMarkerTEM or (marker >= kMarkerRST0 and marker <= kMarkerRST7)) {
+            continue;
+        }
+
+        if (marker == kMarkerEOI or marker == kMarkerSOI) {
+            return false;
+        }
+
+        if (pos + 2 > size) {
+            return false;
+        }
+
+        size_t length = read_u16(data + pos);
+        if (length < 2 or pos + length > size) {
+            return false;
+        }
+
+        const unsigned char* segment = data + pos + 2;
+        size_t segment_length = length - 2;
+
+        if (marker == kMarkerDQT) {
+            if (not parse_dqt(segment, segment_length, info)) {
+                return false;
+            }
+        } else if (marker == kMarkerDHT) {
+            if (not parse_dht(segment, segment_length, info)) {
+                return false;
+            }
+        } else if (marker == kMarkerDRI) {
+            if (segment_length < 2) {
+                return false;
+            }
+            info.restart_interval = read_u16(segment);
+        } else if (is_sof_marker(marker)) {
+            if (not parse_sof(segment, segment_length, marker, info)) {
+                return false;
+            }
+            info.sof_offset = pos - 2;
+        } else if (marker == kMarkerSOS) {
+            if (info.sof_marker == 0) {
+                return false;
+            }
+
+            // DQT may follow SOF, but tables have to be defined before the scan
+            for (int i = 0; i < info.components_count; i++) {
+                if (not info.quant_tables[info.components[i].quant_table].present) {
+                    return false;
+                }
+            }
+
+            info.sos_offset = pos - 2;
+            info.scan_offset = pos + length;
+
+            size_t eoi;
+            if (not find_eoi(data, info.scan_offset, size, eoi)) {
+                return false;
+            }
+
+            info.scan_size = eoi - info.scan_offset;
+
+            return true;
+        }
+
+        pos += length;
+    }
+
+    return false;
+}
+
+static bool
+validate_frame(unsigned width, unsigned height, const JPEGInfo& info)
+{
+    if (info.width == 0 or info.height == 0) {
+        return false;
+    }
+
+    if ((width != 0 and info.width != width) or (height != 0 and info.height != height)) {
+        return false;
+    }
+
+    for (int i = 0; i < info.components_count; i++) {
+        const auto& component = info.components[i];
+        if (component.h_sampling == 0 or component.h_sampling > kMaxSamplingFactor or component.v_sampling == 0
+            or component.v_sampling > kMaxSamplingFactor) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static unsigned
+count_mcus(const JPEGInfo& info)
+{
+    unsigned h_max = 1, v_max = 1;
+
+    // a single component scan isn't interleaved, its MCU is one block
+    if (info.components_count > 1) {
+        for (int i = 0; i < info.components_count; i++) {
+            h_max = std::max<unsigned>(h_max, info.components[i].h_sampling);
+            v_max = std::max<unsigned>(v_max, info.components[i].v_sampling);
+        }
+    }
+
+    unsigned mcu_width = 8 * h_max;
+    unsigned mcu_height = 8 * v_max;
+
+    return ((info.width + mcu_width - 1) / mcu_width) * ((info.height + mcu_height - 1) / mcu_height);
+}
+
+static bool
+validate_scan(const unsigned char* data, const JPEGInfo& info)
+{
+    if (info.scan_size == 0) {
+        return false;
+    }
+
+    // Progressive images carry more scans and tables after the first scan.
+    if (info.sof_marker != kMarkerSOF0 and info.sof_marker != kMarkerSOF1) {
+        return true;
+    }
+
+    auto p = data + info.scan_offset;
+    auto end = p + info.scan_size;
+    unsigned restarts = 0;
+
+    while (p < end) {
+        p = static_cast<const unsigned char*>(std::memchr(p, kMarkerPrefix, end - p));
+        if (p == nullptr) {
+            break;
+        }
+
+        // fill bytes may precede a marker
+        while (p + 1 < end and p[1] == kMarkerPrefix) {
+            p++;
+        }
+
+        if (p + 1 >= end) {
+            return false;
+        }
+
+        auto marker = p[1];
+        if (marker >= kMarkerRST0 and marker <= kMarkerRST7) {
+            if (info.restart_interval == 0 or marker != kMarkerRST0 + restarts % kRestartMarkersCount) {
+                return false;
+            }
+            restarts++;
+        } else if (marker != 0x00) {
+            return false;
+        }
+
+        p += 2;
+    }
+
+    if (info.restart_interval > 0) {
+        auto intervals = (count_mcus(info) + info.restart_interval - 1) / info.restart_interval;
+        if (restarts + 1 != intervals) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+JPEGDefect
+validate_jpeg(const unsigned char* data, size_t size, unsigned width, unsigned height, JPEGInfo& info)
+{
+    if (not parse_jpeg_header(data, size, info)) {
+        return JPEGDefect::Header;
+    }
+
+    if (not validate_frame(width, height, info)) {
+        return JPEGDefect::Frame;
+    }
+
+    if (not validate_scan(data, info)) {
+        return JPEGDefect::Scan;
+    }
+
+    return JPEGDefect::None;
+}
+
+const char*
+jpeg_defect_name(JPEGDefect defect)
+{
+    switch (defect) {
+    case JPEGDefect::None:
+        return "none";
+    case JPEGDefect::Header:
+        return "header";
+    case JPEGDefect::Frame:
+        return "frame";
+    case JPEGDefect::Scan:
+        return "scan";
+    }
+
+    return "unknown";
+}
+
+uint64_t
+hash_quant_tables(const JPEGInfo& info)
+{
+    uint64_t hash = kFNVOffsetBasis;
+
+    for (const auto& table : info.quant_tables) {
+        if (not table.present) {
+            continue;
+        }
+        for (auto value : table.values) {
+            hash = (hash ^ value) * kFNVPrime;
+        }
+    }
+
+    return hash;
+}
+
+int
+estimate_jpeg_quality(const JPEGInfo& info)
+{
+    if (info.components_count == 0) {
+        return 0;
+    }
+
+    const auto& table = info.quant_tables[info.components[0].quant_table];
+    if (not table.present) {
+        return 0;
+    }
+
+    long max_value = table.precision ? 32767 : 255;
+    long best_distance = -1;
+    int best_quality = 0;
+
+    // Same scaling as jpeg_set_quality(), ties go to the higher quality.
+    for (int quality = 1; quality <= kMaxQuality; quality++) {
+        long scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+        long distance = 0;
+
+        for (int i = 0; i < kJPEGQuantTableSize; i++) {
+            long value = std::min(std::max((kStandardLuminanceQuantTable[i] * scale + 50) / 100, 1L), max_value);
+            distance += std::labs(value - table.values[i]);
+        }
+
+        if (best_distance < 0 or distance <= best_distance) {
+            best_distance = distance;
+            best_quality = quality;
+        }
+    }
+
+    return best_quality;
+}
+
+void
+standard_huffman_tables_head(const unsigned char* data, const JPEGInfo& info, std::vector<unsigned char>& output)
+{
+    output.clear();
+    output.reserve(info.sos_offset + sizeof(kStandardHuffmanTables));
+    output.insert(output.end(), data, data + info.sos_offset);
+    output.insert(output.end(), std::begin(kStandardHuffmanTables), std::end(kStandardHuffmanTables));
+}
+
+size_t
+standard_huffman_tables_tail_size(const JPEGInfo& info)
+{
+    return info.scan_offset + info.scan_size + 2 - info.sos_offset;
+}
+
+void
+insert_standard_huffman_tables(const unsigned char* data, const JPEGInfo& info, std::vector<unsigned char>& output)
+{
+    auto tail_size = standard_huffman_tables_tail_size(info);
+
+    standard_huffman_tables_head(data, info, output);
+    output.insert(output.end(), data + info.sos_offset, data + info.sos_offset + tail_size);
+}
+
+static void
+jpeg_vector_init_destination_cb(j_compress_ptr cinfo)
+{
+    auto dest = reinterpret_cast<JPEGVectorDestination*>(cinfo->dest);
+    auto buffer = dest->buffer;
+
+    buffer->resize(std::max(buffer->capacity(), kInitialJPEGBufferSize));
+
+    dest->pub.next_output_byte = buffer->data();
+    dest->pub.free_in_buffer = buffer->size();
+}
+
+static boolean
+jpeg_vector_empty_output_buffer_cb(j_compress_ptr cinfo)
+{
+    auto dest = reinterpret_cast<JPEGVectorDestination*>(cinfo->dest);
+    auto buffer = dest->buffer;
+    auto used = buffer->size();
+
+    buffer->resize(used * 2);
+
+    dest->pub.next_output_byte = buffer->data() + used;
+    dest->pub.free_in_buffer = buffer->size() - used;
+
+    return TRUE;
+}
+
+static void
+jpeg_vector_term_destination_cb(j_compress_ptr cinfo)
+{
+    auto dest = reinterpret_cast<JPEGVectorDestination*>(cinfo->dest);
+
+    dest->buffer->resize(dest->buffer->size() - dest->pub.free_in_buffer);
+}
+
+void
+jpeg_vector_dest(j_compress_ptr cinfo, JPEGVectorDestination& dest, std::vector<unsigned char>& buffer)
+{
+    dest.pub.init_destination = jpeg_vector_init_destination_cb;
+    dest.pub.empty_output_buffer = jpeg_vector_empty_output_buffer_cb;
+    dest.pub.term_destination = jpeg_vector_term_destination_cb;
+    dest.buffer = &buffer;
+    cinfo->dest = &dest.pub;
+}
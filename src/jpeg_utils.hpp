@@ -0,0 +1,104 @@
+#ifndef UVCCAPTURE2_JPEG_UTILS_HPP
+#define UVCCAPTURE2_JPEG_UTILS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <jpeglib.h>
+
+static const int kJPEGMaxComponents = 4;
+static const int kJPEGMaxQuantTables = 4;
+static const int kJPEGQuantTableSize = 64;
+static const size_t kInitialJPEGBufferSize = 256 * 1024;
+
+struct JPEGQuantTable {
+    bool present = false;
+    /* 0 - 8 bit values, 1 - 16 bit values */
+    uint8_t precision = 0;
+    /* values in zigzag order, exactly as they are stored in the DQT segment */
+    std::array<uint16_t, kJPEGQuantTableSize> values;
+};
+
+struct JPEGComponent {
+    uint8_t id = 0;
+    uint8_t h_sampling = 0;
+    uint8_t v_sampling = 0;
+    uint8_t quant_table = 0;
+};
+
+// Result of a lightweight walk over JPEG markers, nothing is decoded.
+struct JPEGInfo {
+    uint16_t width = 0;
+    uint16_t height = 0;
+    uint8_t sof_marker = 0;
+    /* offset of the SOF marker */
+    size_t sof_offset = 0;
+
+    int components_count = 0;
+    std::array<JPEGComponent, kJPEGMaxComponents> components;
+    std::array<JPEGQuantTable, kJPEGMaxQuantTables> quant_tables;
+
+    bool has_dht = false;
+    /* all DHT segments hold tables of ITU T.81, K.3, also true if there is no DHT */
+    bool standard_huffman_tables = true;
+    uint16_t restart_interval = 0;
+
+    /* offset of the SOS marker */
+    size_t sos_offset = 0;
+    /* offset of the first byte of entropy-coded data (right after the SOS segment) */
+    size_t scan_offset = 0;
+    /* size of entropy-coded data, up to but not including the EOI marker */
+    size_t scan_size = 0;
+};
+
+// Walks JPEG markers from SOI up to the first SOS and locates the entropy-coded data.
+// Returns false if the data doesn't look like a baseline/progressive JPEG image,
+// also if a component refers to a quantization table which isn't defined.
+bool parse_jpeg_header(const unsigned char* data, size_t size, JPEGInfo& info);
+
+enum class JPEGDefect {
+    None,
+    Header, /* missing SOI/EOI, malformed or truncated marker segments, undefined quantization tables */
+    Frame, /* unexpected dimensions or sampling factors */
+    Scan /* stray markers, broken restart sequence or truncated entropy-coded data */
+};
+
+// Structural check of an image in a fraction of the decoding cost: marker
+// segments, frame header and entropy-coded data of the first scan are checked
+// for consistency, the data is scanned for markers with memchr(). Expected
+// dimensions are only checked if not zero.
+JPEGDefect validate_jpeg(const unsigned char* data, size_t size, unsigned width, unsigned height, JPEGInfo& info);
+
+const char* jpeg_defect_name(JPEGDefect defect);
+
+// FNV-1a hash of all quantization tables, identifies them to cache derived values.
+uint64_t hash_quant_tables(const JPEGInfo& info);
+
+// Finds the libjpeg quality setting (1-100) which gives the luminance
+// quantization table closest to the image's one, 0 if there is no table.
+// Tables of other encoders are matched approximately.
+int estimate_jpeg_quality(const JPEGInfo& info);
+
+// Copies the image into output with the standard Huffman tables (ITU T.81, K.3)
+// inserted before SOS. MJPEG streams of UVC cameras rely on these tables without
+// carrying them, which many image viewers don't accept. Anything past EOI is dropped.
+void insert_standard_huffman_tables(const unsigned char* data, const JPEGInfo& info, std::vector<unsigned char>& output);
+
+// Same as insert_standard_huffman_tables() split in two: output gets the image
+// up to SOS followed by the tables, the rest of the image is the tail which
+// starts at info.sos_offset, so it can be passed on without copying.
+void standard_huffman_tables_head(const unsigned char* data, const JPEGInfo& info, std::vector<unsigned char>& output);
+size_t standard_huffman_tables_tail_size(const JPEGInfo& info);
+
+// libjpeg destination manager which stores compressed image into a reusable buffer
+struct JPEGVectorDestination {
+    struct jpeg_destination_mgr pub;
+    std::vector<unsigned char>* buffer;
+};
+
+void jpeg_vector_dest(j_compress_ptr cinfo, JPEGVectorDestination& dest, std::vector<unsigned char>& buffer);
+
+#endif
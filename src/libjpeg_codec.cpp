@@ -0,0 +1,349 @@
+#include "libjpeg_codec.hpp"
+
+#include <setjmp.h>
+
+#include "easylogging++/easylogging++.h"
+
+#include "jpeg_utils.hpp"
+
+struct JPEGErrorManager {
+    /* "public" fields */
+    struct jpeg_error_mgr pub;
+    bool quiet;
+    /* for return to caller */
+    jmp_buf setjmp_buffer;
+    /* message of the last error, every worker decodes with its own manager */
+    char last_error_msg[JMSG_LENGTH_MAX];
+};
+
+static void
+jpeg_error_exit_cb(j_common_ptr cinfo)
+{
+    // cinfo->err actually points to a JPEGErrorManager struct
+    JPEGErrorManager* myerr = (JPEGErrorManager*)cinfo->err;
+    // note : *(cinfo->err) is now equivalent to myerr->pub
+
+    // output_message is a method to print an error message
+    // (* (cinfo->err->output_message) ) (cinfo);
+
+    // Create the message
+    myerr->pub.format_message(cinfo, myerr->last_error_msg);
+
+    // Jump to the setjmp point
+    longjmp(myerr->setjmp_buffer, 1);
+}
+
+static void
+jpeg_output_message_cb(j_common_ptr cinfo)
+{
+    JPEGErrorManager* error_manager = (JPEGErrorManager*)cinfo->err;
+
+    if (not error_manager->quiet) {
+        error_manager->pub.format_message(cinfo, error_manager->last_error_msg);
+        LOG(WARNING) << error_manager->last_error_msg;
+    }
+}
+
+LibJPEGCodec::LibJPEGCodec(const CodecSettings& settings)
+    : profile(settings.profile)
+    , quiet(settings.quiet)
+{
+    if (settings.strips > 1) {
+        strip_encoder = std::unique_ptr<StripEncoder>(new StripEncoder(settings.strips));
+    }
+}
+
+void
+LibJPEGCodec::reserve(unsigned width, unsigned height)
+{
+    rgb_image.reserve(static_cast<size_t>(width) * height * 3);
+}
+
+bool
+LibJPEGCodec::recompress(const unsigned char* data, size_t size, int quality, unsigned scale_denom, bool keep_ycbcr,
+    std::vector<unsigned char>& output)
+{
+    if (keep_ycbcr and ycbcr_supported and scale_denom == 1) {
+        bool supported = true;
+        if (decompress_ycbcr(data, size, ycbcr_image, supported)) {
+            return compress(ycbcr_image, quality, output);
+        }
+
+        if (supported) {
+            LOG(ERROR) << "image decompression failed!";
+            return false;
+        }
+
+        LOG(WARNING) << "JPEG sampling isn't supported by '--raw-ycbcr', converting through RGB";
+        ycbcr_supported = false;
+    }
+
+    if (not decompress(data, size, scale_denom, rgb_image)) {
+        LOG(ERROR) << "image decompression failed!";
+        return false;
+    }
+
+    return compress(rgb_image, quality, output);
+}
+
+bool
+LibJPEGCodec::decompress(const unsigned char* data, size_t size, unsigned scale_denom, RGBImage& image)
+{
+    struct jpeg_decompress_struct cinfo;
+
+    JPEGErrorManager jerr;
+    jerr.quiet = quiet;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit_cb;
+    jerr.pub.output_message = jpeg_output_message_cb;
+
+    if (setjmp(jerr.setjmp_buffer)) {
+        // If we get here, the JPEG code has signaled an error.
+        if (not quiet) {
+            LOG(WARNING) << jerr.last_error_msg;
+        }
+
+        jpeg_destroy_decompress(&cinfo);
+
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data), size);
+
+    auto rc = jpeg_read_header(&cinfo, TRUE);
+    if (rc != 1) {
+        LOG(ERROR) << "broken JPEG";
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale_denom;
+    cinfo.dct_method = profile.dct_method;
+    cinfo.do_fancy_upsampling = profile.fancy_upsampling;
+    cinfo.do_block_smoothing = profile.block_smoothing;
+
+    jpeg_start_decompress(&cinfo);
+
+    auto width = cinfo.output_width;
+    auto height = cinfo.output_height;
+    auto pixel_size = cinfo.output_components;
+    auto row_stride = width * pixel_size;
+    auto raw_size = width * height * pixel_size;
+
+    // images which weren't sized for the negotiated format grow silently
+    auto reserved = image.capacity > 0;
+    if (image.reserve(raw_size) and reserved) {
+        LOG(INFO) << "frame is larger than the negotiated format, decode buffer has grown to " << raw_size << " bytes";
+    }
+
+    image.width = width;
+    image.height = height;
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+        unsigned char* buffer_array[1];
+        buffer_array[0] = image.raw_data.get() + (cinfo.output_scanline) * row_stride;
+        jpeg_read_scanlines(&cinfo, buffer_array, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    return true;
+}
+
+bool
+LibJPEGCodec::decompress_ycbcr(const unsigned char* data, size_t size, YCbCrImage& image, bool& supported)
+{
+    struct jpeg_decompress_struct cinfo;
+
+    JPEGErrorManager jerr;
+    jerr.quiet = quiet;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit_cb;
+    jerr.pub.output_message = jpeg_output_message_cb;
+
+    if (setjmp(jerr.setjmp_buffer)) {
+        // If we get here, the JPEG code has signaled an error.
+        if (not quiet) {
+            LOG(WARNING) << jerr.last_error_msg;
+        }
+
+        jpeg_destroy_decompress(&cinfo);
+
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data), size);
+
+    auto rc = jpeg_read_header(&cinfo, TRUE);
+    if (rc != 1) {
+        LOG(ERROR) << "broken JPEG";
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    const auto comp = cinfo.comp_info;
+    supported = cinfo.jpeg_color_space == JCS_YCbCr and cinfo.num_components == kYCbCrPlanes and comp[0].h_samp_factor <= 2
+        and comp[0].v_samp_factor <= 2 and comp[1].h_samp_factor == 1 and comp[1].v_samp_factor == 1 and comp[2].h_samp_factor == 1
+        and comp[2].v_samp_factor == 1;
+
+    if (not supported) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    cinfo.raw_data_out = TRUE;
+    cinfo.out_color_space = JCS_YCbCr;
+    cinfo.dct_method = profile.dct_method;
+    cinfo.do_block_smoothing = profile.block_smoothing;
+
+    jpeg_start_decompress(&cinfo);
+
+    image.resize(cinfo.output_width, cinfo.output_height, comp[0].h_samp_factor, comp[0].v_samp_factor);
+
+    JSAMPROW rows[kYCbCrPlanes][2 * DCTSIZE];
+    JSAMPARRAY planes[kYCbCrPlanes] = { rows[0], rows[1], rows[2] };
+    auto mcu_height = DCTSIZE * image.v_sampling;
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+        for (int plane = 0; plane < kYCbCrPlanes; plane++) {
+            auto count = plane == 0 ? mcu_height : DCTSIZE;
+            auto first = plane == 0 ? cinfo.output_scanline : cinfo.output_scanline / image.v_sampling;
+            for (unsigned i = 0; i < count; i++) {
+                rows[plane][i] = image.row(plane, first + i);
+            }
+        }
+        jpeg_read_raw_data(&cinfo, planes, mcu_height);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    image.pad_edges();
+
+    return true;
+}
+
+void
+LibJPEGCodec::apply_profile(struct jpeg_compress_struct& cinfo) const
+{
+    cinfo.dct_method = profile.dct_method;
+    cinfo.optimize_coding = profile.optimize_coding;
+#if JPEG_LIB_VERSION >= 70
+    cinfo.do_fancy_downsampling = profile.fancy_upsampling;
+#endif
+}
+
+bool
+LibJPEGCodec::compress(const RGBImage& image, int quality, std::vector<unsigned char>& output)
+{
+    if (strip_encoder) {
+        if (not strip_encoder->encode_rgb(image.raw_data.get(), image.width, image.height, quality, profile.dct_method, output)) {
+            LOG(ERROR) << "image compression failed!";
+            return false;
+        }
+        return true;
+    }
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+
+    JSAMPROW row_pointer[1];
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    JPEGVectorDestination dest;
+    jpeg_vector_dest(&cinfo, dest, output);
+
+    cinfo.image_width = image.width; /* image width and height, in pixels */
+    cinfo.image_height = image.height;
+    cinfo.input_components = 3; /* # of color components per pixel */
+    cinfo.in_color_space = JCS_RGB; /* colorspace of input image */
+
+    jpeg_set_defaults(&cinfo);
+
+    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+    apply_profile(cinfo);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    auto row_stride = image.width * 3; /* JSAMPLEs per row in image_buffer */
+    while (cinfo.next_scanline < cinfo.image_height) {
+        row_pointer[0] = &(image.raw_data.get()[cinfo.next_scanline * row_stride]);
+        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    return true;
+}
+
+// Encodes planar YCbCr through libjpeg's raw data interface, which skips
+// color conversion and downsampling.
+bool
+LibJPEGCodec::compress(const YCbCrImage& image, int quality, std::vector<unsigned char>& output)
+{
+    if (strip_encoder) {
+        if (not strip_encoder->encode_ycbcr(image, quality, profile.dct_method, output)) {
+            LOG(ERROR) << "image compression failed!";
+            return false;
+        }
+        return true;
+    }
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    JPEGVectorDestination dest;
+    jpeg_vector_dest(&cinfo, dest, output);
+
+    cinfo.image_width = image.width;
+    cinfo.image_height = image.height;
+    cinfo.input_components = kYCbCrPlanes;
+    cinfo.in_color_space = JCS_YCbCr;
+
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+
+    apply_profile(cinfo);
+
+    cinfo.raw_data_in = TRUE;
+    cinfo.comp_info[0].h_samp_factor = image.h_sampling;
+    cinfo.comp_info[0].v_samp_factor = image.v_sampling;
+    for (int i = 1; i < kYCbCrPlanes; i++) {
+        cinfo.comp_info[i].h_samp_factor = 1;
+        cinfo.comp_info[i].v_samp_factor = 1;
+    }
+
+    jpeg_start_compress(&cinfo, TRUE);
+
+    /* one MCU row: DCTSIZE rows of every chroma plane and v_sampling times more of luma */
+    JSAMPROW rows[kYCbCrPlanes][2 * DCTSIZE];
+    JSAMPARRAY planes[kYCbCrPlanes] = { rows[0], rows[1], rows[2] };
+    auto mcu_height = DCTSIZE * image.v_sampling;
+
+    while (cinfo.next_scanline < cinfo.image_height) {
+        for (int plane = 0; plane < kYCbCrPlanes; plane++) {
+            auto count = plane == 0 ? mcu_height : DCTSIZE;
+            auto first = plane == 0 ? cinfo.next_scanline : cinfo.next_scanline / image.v_sampling;
+            for (unsigned i = 0; i < count; i++) {
+                rows[plane][i] = const_cast<JSAMPROW>(image.row(plane, first + i));
+            }
+        }
+        jpeg_write_raw_data(&cinfo, planes, mcu_height);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    return true;
+}
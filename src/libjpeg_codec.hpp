@@ -0,0 +1,44 @@
+#ifndef UVCCAPTURE2_LIBJPEG_CODEC_HPP
+#define UVCCAPTURE2_LIBJPEG_CODEC_HPP
+
+#include <memory>
+
+#include "jpeg_codec.hpp"
+#include "strip_encoder.hpp"
+
+// Backend built on the jpeglib API. Errors in damaged frames are caught with
+// setjmp()/longjmp() from the error manager. With more than one strip in the
+// settings frames are encoded in parallel by StripEncoder.
+class LibJPEGCodec : public JPEGCodec
+{
+public:
+    LibJPEGCodec(const LibJPEGCodec&) = delete;
+    LibJPEGCodec(const CodecSettings& settings);
+
+    bool decompress(const unsigned char* data, size_t size, unsigned scale_denom, RGBImage& image) override;
+    bool compress(const RGBImage& image, int quality, std::vector<unsigned char>& output) override;
+    bool compress(const YCbCrImage& image, int quality, std::vector<unsigned char>& output) override;
+    bool recompress(const unsigned char* data, size_t size, int quality, unsigned scale_denom, bool keep_ycbcr,
+        std::vector<unsigned char>& output) override;
+    void reserve(unsigned width, unsigned height) override;
+
+    // Decodes into planar YCbCr with raw_data_out, leaving out color conversion
+    // and chroma upsampling. Only 4:4:4, 4:2:2 and 4:2:0 YCbCr images are
+    // supported, supported is cleared for anything else.
+    bool decompress_ycbcr(const unsigned char* data, size_t size, YCbCrImage& image, bool& supported);
+
+    void apply_profile(struct jpeg_compress_struct& cinfo) const;
+
+private:
+    CodecProfile profile;
+    bool quiet;
+    std::unique_ptr<StripEncoder> strip_encoder;
+    /* cleared by the first frame whose sampling YCbCr re-encoding can't keep */
+    bool ycbcr_supported = true;
+
+    // decoded images, reused between frames
+    RGBImage rgb_image;
+    YCbCrImage ycbcr_image;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include <sstream>
+
+#include "easylogging++/easylogging++.h"
+
+#include "metrics.hpp"
+
+void
+Metrics::increment(const std::string& name, int64_t value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    values[name] += value;
+}
+
+void
+Metrics::set(const std::string& name, int64_t value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    values[name] = value;
+}
+
+int64_t
+Metrics::get(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = values.find(name);
+
+    return iter == values.end() ? 0 : iter->second;
+}
+
+void
+Metrics::report()
+{
+    std::ostringstream line;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (values.empty()) {
+            return;
+        }
+        for (const auto& value : values) {
+            line << " " << value.first << "=" << value.second;
+        }
+    }
+
+    LOG(INFO) << "metrics:" << line.str();
+}
@@ -0,0 +1,28 @@
+#ifndef UVCCAPTURE2_METRICS_HPP
+#define UVCCAPTURE2_METRICS_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Named counters and gauges which are periodically written to the log as
+// "metrics: name=value ..." lines, so they can be scraped by the log collector.
+class Metrics
+{
+public:
+    Metrics(const Metrics&) = delete;
+    Metrics() = default;
+
+    void increment(const std::string& name, int64_t value = 1);
+    void set(const std::string& name, int64_t value);
+    int64_t get(const std::string& name);
+
+    void report();
+
+private:
+    std::mutex mutex;
+    std::map<std::string, int64_t> values;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "motion_detector.hpp"
+
+// Counts samples differing from the background by more than threshold and
+// moves the background a quarter of the way towards the frame.
+static size_t
+compare_and_update(const uint8_t* frame, uint8_t* background, size_t count, uint8_t threshold)
+{
+    size_t changed = 0;
+
+#if defined(__SSE2__)
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(threshold));
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; count >= 16; count -= 16) {
+        auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frame));
+        auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(background));
+
+        auto diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+        auto unchanged = _mm_cmpeq_epi8(_mm_subs_epu8(diff, limit), zero);
+        changed += 16 - __builtin_popcount(_mm_movemask_epi8(unchanged));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(background), _mm_avg_epu8(b, _mm_avg_epu8(b, a)));
+
+        frame += 16;
+        background += 16;
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t limit = vdupq_n_u8(threshold);
+
+    for (; count >= 16; count -= 16) {
+        auto a = vld1q_u8(frame);
+        auto b = vld1q_u8(background);
+
+        auto over = vshrq_n_u8(vcgtq_u8(vabdq_u8(a, b), limit), 7);
+        auto sums = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(over)));
+        changed += vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
+
+        vst1q_u8(background, vrhaddq_u8(b, vrhaddq_u8(b, a)));
+
+        frame += 16;
+        background += 16;
+    }
+#endif
+
+    for (; count > 0; count--) {
+        int a = *frame++;
+        int b = *background;
+
+        if (std::abs(a - b) > threshold) {
+            changed++;
+        }
+        // same rounding as the vector averages
+        *background++ = (b + (b + a + 1) / 2 + 1) / 2;
+    }
+
+    return changed;
+}
+
+MotionDetector::MotionDetector(const MotionDetectorSettings& detector_settings)
+    : settings(detector_settings)
+{
+}
+
+bool
+MotionDetector::detect(const std::vector<uint8_t>& dc_image)
+{
+    if (dc_image.empty() or background.size() != dc_image.size()) {
+        background = dc_image;
+        changed = 0;
+        return false;
+    }
+
+    auto threshold = static_cast<uint8_t>(std::min(std::max(settings.threshold, 0), 255));
+    auto count = compare_and_update(dc_image.data(), background.data(), dc_image.size(), threshold);
+
+    changed = 100.0 * count / dc_image.size();
+
+    return changed > settings.area_percent;
+}
@@ -0,0 +1,45 @@
+#ifndef UVCCAPTURE2_MOTION_DETECTOR_HPP
+#define UVCCAPTURE2_MOTION_DETECTOR_HPP
+
+#include <cstdint>
+#include <vector>
+
+static const int kDefaultMotionThreshold = 25;
+static const double kDefaultMotionAreaPercent = 1.0;
+
+struct MotionDetectorSettings {
+    /* a block has changed if its luma differs from the background by more than this */
+    int threshold = kDefaultMotionThreshold;
+    /* motion is reported if more than this share of blocks (in percents) has changed */
+    double area_percent = kDefaultMotionAreaPercent;
+};
+
+// Detects motion on DC images (see DCTAnalyzer), one sample per 8x8 block.
+// Every frame is compared to a background which follows the scene with an
+// exponential average (weight of the new frame is 1/4), so lighting changes
+// are absorbed within a few frames. Comparison and update run 16 blocks at a
+// time with SSE2/NEON.
+class MotionDetector
+{
+public:
+    MotionDetector(const MotionDetector&) = delete;
+    MotionDetector(const MotionDetectorSettings& detector_settings);
+
+    // Returns true if the frame differs from the background. The first frame,
+    // or a frame of a different size, only initializes the background.
+    bool detect(const std::vector<uint8_t>& dc_image);
+
+    // Share of changed blocks in the last frame, in percents.
+    double
+    changed_percent() const
+    {
+        return changed;
+    }
+
+private:
+    MotionDetectorSettings settings;
+    std::vector<uint8_t> background;
+    double changed = 0;
+};
+
+#endif
@@ -0,0 +1,276 @@
+#include <netdb.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+
+#include "easylogging++/easylogging++.h"
+
+#include "rtp_sender.hpp"
+
+static const uint8_t kRTPVersion = 2;
+static const uint8_t kRTPPayloadTypeJPEG = 26;
+static const uint32_t kRTPClockRate = 90000;
+
+static const size_t kRTPHeaderSize = 12;
+static const size_t kJPEGHeaderSize = 8;
+static const size_t kRestartMarkerHeaderSize = 4;
+static const size_t kQuantTableHeaderSize = 4;
+
+static const uint8_t kRTPJPEGTypeYUV422 = 0;
+static const uint8_t kRTPJPEGTypeYUV420 = 1;
+static const uint8_t kRTPJPEGTypeRestartFlag = 64;
+static const uint8_t kRTPJPEGDynamicQuantTables = 255;
+
+static const unsigned char kBaselineSOF = 0xC0;
+
+static inline unsigned char*
+put_u16(unsigned char* p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+
+    return p + 2;
+}
+
+static inline unsigned char*
+put_u24(unsigned char* p, uint32_t v)
+{
+    p[0] = (v >> 16) & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = v & 0xFF;
+
+    return p + 3;
+}
+
+static inline unsigned char*
+put_u32(unsigned char* p, uint32_t v)
+{
+    p = put_u16(p, v >> 16);
+
+    return put_u16(p, v & 0xFFFF);
+}
+
+static bool
+rtp_jpeg_type(const JPEGInfo& info, uint8_t& type)
+{
+    if (info.sof_marker != kBaselineSOF or info.components_count != 3) {
+        return false;
+    }
+
+    for (int i = 1; i < 3; i++) {
+        if (info.components[i].h_sampling != 1 or info.components[i].v_sampling != 1) {
+            return false;
+        }
+    }
+
+    const auto& luma = info.components[0];
+    if (luma.h_sampling == 2 and luma.v_sampling == 1) {
+        type = kRTPJPEGTypeYUV422;
+    } else if (luma.h_sampling == 2 and luma.v_sampling == 2) {
+        type = kRTPJPEGTypeYUV420;
+    } else {
+        return false;
+    }
+
+    if (info.restart_interval > 0) {
+        type |= kRTPJPEGTypeRestartFlag;
+    }
+
+    return true;
+}
+
+RTPJPEGSender::~RTPJPEGSender()
+{
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+bool
+RTPJPEGSender::open(const std::string& destination, size_t packet_size)
+{
+    auto delimeter = destination.rfind(":");
+    if (delimeter == std::string::npos or delimeter == 0 or delimeter + 1 >= destination.size()) {
+        LOG(ERROR) << "invalid RTP destination, expected host:port: " << destination;
+        return false;
+    }
+
+    auto host = destination.substr(0, delimeter);
+    auto port = destination.substr(delimeter + 1);
+
+    if (host.size() > 2 and host.front() == '[' and host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    struct addrinfo* result = nullptr;
+    auto rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+    if (rc != 0) {
+        LOG(ERROR) << "couldn't resolve '" << destination << "': " << gai_strerror(rc);
+        return false;
+    }
+
+    for (auto ai = result; ai != nullptr; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(result);
+
+    if (fd == -1) {
+        LOG(ERROR) << "couldn't create UDP socket for '" << destination << "': " << strerror(errno);
+        return false;
+    }
+
+    size_t min_packet_size = kRTPHeaderSize + kJPEGHeaderSize + kRestartMarkerHeaderSize + kQuantTableHeaderSize
+        + 2 * kJPEGQuantTableSize * 2 + 1;
+    if (packet_size < min_packet_size) {
+        LOG(ERROR) << "RTP packet size is too small, has to be at least " << min_packet_size;
+        return false;
+    }
+
+    max_packet_size = packet_size;
+    packet.resize(max_packet_size);
+
+    std::random_device rd;
+    ssrc = rd();
+    sequence = rd() & 0xFFFF;
+
+    return true;
+}
+
+bool
+RTPJPEGSender::send(const unsigned char* data, size_t size, const struct timeval& timestamp, bool& supported)
+{
+    JPEGInfo info;
+    uint8_t type = 0;
+    std::string reason;
+
+    if (not parse_jpeg_header(data, size, info)) {
+        reason = "malformed JPEG frame";
+    } else if (not rtp_jpeg_type(info, type)) {
+        reason = "JPEG layout is not supported by RTP/JPEG (baseline YUV 4:2:2 or 4:2:0 only)";
+    } else if (not info.standard_huffman_tables) {
+        // the receiver rebuilds the standard tables, a frame coded with any other ones would decode as garbage
+        reason = "JPEG frame uses non-standard Huffman tables";
+    } else if (info.width > kRTPJPEGMaxDimension or info.height > kRTPJPEGMaxDimension) {
+        reason = "image is too large for RTP/JPEG: " + std::to_string(info.width) + "x" + std::to_string(info.height);
+    }
+
+    supported = reason.empty();
+    if (not supported) {
+        // a camera keeps sending frames of the same kind, one warning is enough
+        if (not unsupported_reported) {
+            LOG(WARNING) << reason << ", such frames are not sent over RTP";
+            unsupported_reported = true;
+        }
+        return true;
+    }
+
+    // the parser has checked that tables of all components are defined
+    const auto& luma_table = info.quant_tables[info.components[0].quant_table];
+    const auto& chroma_table = info.quant_tables[info.components[1].quant_table];
+
+    uint32_t rtp_timestamp = static_cast<uint32_t>(timestamp.tv_sec) * kRTPClockRate
+        + static_cast<uint32_t>(static_cast<uint64_t>(timestamp.tv_usec) * kRTPClockRate / 1000000);
+
+    const unsigned char* scan = data + info.scan_offset;
+    size_t scan_size = info.scan_size;
+    size_t offset = 0;
+
+    uint8_t width_blocks = (info.width + 7) / 8;
+    uint8_t height_blocks = (info.height + 7) / 8;
+
+    do {
+        unsigned char* p = packet.data();
+
+        // RTP header
+        *p++ = kRTPVersion << 6;
+        *p++ = kRTPPayloadTypeJPEG;
+        p = put_u16(p, sequence++);
+        p = put_u32(p, rtp_timestamp);
+        p = put_u32(p, ssrc);
+
+        // JPEG header
+        *p++ = 0; /* type-specific */
+        p = put_u24(p, offset);
+        *p++ = type;
+        *p++ = kRTPJPEGDynamicQuantTables;
+        *p++ = width_blocks;
+        *p++ = height_blocks;
+
+        if (info.restart_interval > 0) {
+            p = put_u16(p, info.restart_interval);
+            p = put_u16(p, 0xFFFF); /* F = 1, L = 1, restart count = 0x3FFF */
+        }
+
+        if (offset == 0) {
+            uint16_t luma_size = kJPEGQuantTableSize * (luma_table.precision + 1);
+            uint16_t chroma_size = kJPEGQuantTableSize * (chroma_table.precision + 1);
+
+            *p++ = 0; /* MBZ */
+            *p++ = luma_table.precision | (chroma_table.precision << 1);
+            p = put_u16(p, luma_size + chroma_size);
+
+            for (const auto* table : { &luma_table, &chroma_table }) {
+                for (int i = 0; i < kJPEGQuantTableSize; i++) {
+                    if (table->precision) {
+                        p = put_u16(p, table->values[i]);
+                    } else {
+                        *p++ = table->values[i];
+                    }
+                }
+            }
+        }
+
+        size_t header_size = p - packet.data();
+        size_t chunk = std::min(max_packet_size - header_size, scan_size - offset);
+
+        std::memcpy(p, scan + offset, chunk);
+        offset += chunk;
+
+        if (offset == scan_size) {
+            packet[1] |= 0x80; /* marker bit on the last packet of the frame */
+        }
+
+        if (not send_packet(header_size + chunk)) {
+            return false;
+        }
+    } while (offset < scan_size);
+
+    return true;
+}
+
+bool
+RTPJPEGSender::send_packet(size_t size)
+{
+    auto rc = ::send(fd, packet.data(), size, 0);
+    if (rc < 0) {
+        // nobody is listening on the other side yet, that's fine for a live feed
+        if (errno == ECONNREFUSED) {
+            return true;
+        }
+
+        LOG(ERROR) << "sending RTP packet failed: " << strerror(errno);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef UVCCAPTURE2_RTP_SENDER_HPP
+#define UVCCAPTURE2_RTP_SENDER_HPP
+
+#include <sys/time.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "jpeg_utils.hpp"
+
+static const size_t kDefaultRTPPacketSize = 1400;
+/* width and height are sent in 8 pixel blocks, a byte each */
+static const unsigned kRTPJPEGMaxDimension = 2040;
+
+// Sends JPEG frames over UDP as RTP/JPEG payload (RFC 2435). Quantization
+// tables are sent in-band with every frame (Q = 255), Huffman tables can't
+// be sent at all, so frames with tables other than the standard ones from
+// the JPEG specification are rejected.
+class RTPJPEGSender
+{
+public:
+    RTPJPEGSender(const RTPJPEGSender&) = delete;
+    RTPJPEGSender() = default;
+
+    ~RTPJPEGSender();
+
+    // destination has the "host:port" form
+    bool open(const std::string& destination, size_t packet_size);
+
+    // Returns false on socket errors only. Frames RTP/JPEG can't carry (not
+    // baseline 4:2:2 or 4:2:0, non-standard Huffman tables, larger than
+    // kRTPJPEGMaxDimension) are skipped with supported cleared, the first one
+    // is reported.
+    bool send(const unsigned char* data, size_t size, const struct timeval& timestamp, bool& supported);
+
+private:
+    int fd = -1;
+    size_t max_packet_size = kDefaultRTPPacketSize;
+    uint16_t sequence = 0;
+    uint32_t ssrc = 0;
+    bool unsupported_reported = false;
+
+    std::vector<unsigned char> packet;
+
+    bool send_packet(size_t size);
+};
+
+#endif
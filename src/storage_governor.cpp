@@ -0,0 +1,91 @@
+#include <algorithm>
+
+#include "easylogging++/easylogging++.h"
+
+#include "storage_governor.hpp"
+
+static const std::chrono::seconds kGovernorCheckInterval(1);
+/* weight of the latest write in the average latency */
+static const double kLatencySmoothing = 0.2;
+
+StorageGovernor::StorageGovernor(const StorageGovernorSettings& governor_settings, Metrics& metrics_registry)
+    : settings(governor_settings)
+    , metrics(metrics_registry)
+    , last_check(std::chrono::steady_clock::now())
+{
+}
+
+void
+StorageGovernor::record_write(double latency_ms)
+{
+    average_latency_ms += kLatencySmoothing * (latency_ms - average_latency_ms);
+}
+
+void
+StorageGovernor::update(FrameStorage& storage)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_check < kGovernorCheckInterval) {
+        return;
+    }
+    last_check = now;
+
+    double free_percent = 100.0;
+    if (not storage.free_space(free_percent)) {
+        return;
+    }
+
+    metrics.set("storage_free_permille", static_cast<int64_t>(free_percent * 10));
+    metrics.set("storage_write_latency_us", static_cast<int64_t>(average_latency_ms * 1000));
+
+    bool pressure = free_percent < settings.min_free_percent or average_latency_ms > settings.max_write_latency_ms;
+    bool relief = free_percent >= settings.min_free_percent * 1.5 and average_latency_ms <= settings.max_write_latency_ms / 2;
+
+    auto previous = level;
+    if (pressure and level < QuarterFrameRate) {
+        level = static_cast<Level>(level + 1);
+    } else if (relief and level > Normal) {
+        level = static_cast<Level>(level - 1);
+    }
+
+    if (level != previous) {
+        LOG(INFO) << "storage governor: level " << previous << " -> " << level << " (free space " << free_percent
+                  << "%, write latency " << average_latency_ms << " ms)";
+        metrics.set("governor_level", level);
+        metrics.increment("governor_level_changes");
+    }
+}
+
+int
+StorageGovernor::quality(int requested) const
+{
+    if (level == Normal or requested <= settings.min_quality) {
+        return requested;
+    }
+
+    if (level == ReducedQuality) {
+        return settings.min_quality + (requested - settings.min_quality) / 2;
+    }
+
+    return settings.min_quality;
+}
+
+unsigned
+StorageGovernor::scale_denom() const
+{
+    return level >= ReducedResolution ? 2 : 1;
+}
+
+bool
+StorageGovernor::drop_frame()
+{
+    frame_index++;
+
+    if (level == HalfFrameRate) {
+        return frame_index % 2 != 0;
+    } else if (level == QuarterFrameRate) {
+        return frame_index % 4 != 0;
+    }
+
+    return false;
+}
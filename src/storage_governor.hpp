@@ -0,0 +1,62 @@
+#ifndef UVCCAPTURE2_STORAGE_GOVERNOR_HPP
+#define UVCCAPTURE2_STORAGE_GOVERNOR_HPP
+
+#include <chrono>
+#include <cstdint>
+
+#include "frame_storage.hpp"
+#include "metrics.hpp"
+
+static const double kDefaultGovernorFreeSpacePercent = 10.0;
+static const double kDefaultGovernorLatencyMs = 100.0;
+static const int kDefaultGovernorMinQuality = 30;
+
+struct StorageGovernorSettings {
+    /* below this amount of free space (in percents) the output is considered under pressure */
+    double min_free_percent = kDefaultGovernorFreeSpacePercent;
+    /* above this average write latency the output is considered under pressure */
+    double max_write_latency_ms = kDefaultGovernorLatencyMs;
+    /* re-encoding quality is never lowered below this value */
+    int min_quality = kDefaultGovernorMinQuality;
+};
+
+// Watches free space and write latency of the output filesystem and degrades
+// the output step by step while it is under pressure: first lowers JPEG quality,
+// then halves resolution (scaled decode), then thins the frame rate. Settings are
+// restored one step at a time once the pressure eases. Pressure is re-evaluated
+// at most once per second, every level change is logged and exported as metrics.
+class StorageGovernor
+{
+public:
+    enum Level {
+        Normal = 0,
+        ReducedQuality,
+        ReducedResolution,
+        HalfFrameRate,
+        QuarterFrameRate,
+    };
+
+    StorageGovernor(const StorageGovernor&) = delete;
+    StorageGovernor(const StorageGovernorSettings& governor_settings, Metrics& metrics_registry);
+
+    void record_write(double latency_ms);
+    void update(FrameStorage& storage);
+
+    int quality(int requested) const;
+    unsigned scale_denom() const;
+
+    // Returns true if the current frame has to be dropped to thin the frame rate.
+    bool drop_frame();
+
+private:
+    StorageGovernorSettings settings;
+    Metrics& metrics;
+
+    Level level = Normal;
+    double average_latency_ms = 0;
+    uint64_t frame_index = 0;
+
+    std::chrono::steady_clock::time_point last_check;
+};
+
+#endif
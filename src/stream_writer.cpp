@@ -0,0 +1,198 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "easylogging++/easylogging++.h"
+
+#include "stream_writer.hpp"
+
+// bigger pipe means fewer buffers held back from the driver while the reader catches up
+static const int kStreamPipeSize = 1024 * 1024;
+
+StreamWriter::~StreamWriter()
+{
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+bool
+StreamWriter::open_stdout(StreamFormat stream_format, size_t max_held)
+{
+    format = stream_format;
+    max_held_buffers = max_held;
+
+    fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG(ERROR) << "couldn't duplicate stdout: " << strerror(errno);
+        return false;
+    }
+
+    std::cout.flush();
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        LOG(ERROR) << "couldn't redirect stdout to stderr: " << strerror(errno);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        LOG(ERROR) << "fstat() failed: " << strerror(errno);
+        return false;
+    }
+
+    splice_enabled = S_ISFIFO(st.st_mode);
+    if (splice_enabled) {
+        // not fatal, the default pipe size works too
+        fcntl(fd, F_SETPIPE_SZ, kStreamPipeSize);
+    }
+
+    return true;
+}
+
+bool
+StreamWriter::parse_format(const std::string& name, StreamFormat& stream_format)
+{
+    if (name == "raw") {
+        stream_format = StreamFormat::Raw;
+    } else if (name == "length-prefixed") {
+        stream_format = StreamFormat::LengthPrefixed;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+bool
+StreamWriter::write_frame(const unsigned char* data, size_t size)
+{
+    return write_header(size) and write_all(data, size);
+}
+
+bool
+StreamWriter::splice_frame(const unsigned char* data, size_t size, uint32_t buffer_index, bool& spliced)
+{
+    return splice_frame(nullptr, 0, data, size, buffer_index, spliced);
+}
+
+bool
+StreamWriter::splice_frame(
+    const unsigned char* head, size_t head_size, const unsigned char* data, size_t size, uint32_t buffer_index, bool& spliced)
+{
+    spliced = false;
+
+    if (not write_header(head_size + size) or not write_all(head, head_size)) {
+        return false;
+    }
+
+    if (not splice_enabled or pending.size() >= max_held_buffers) {
+        return write_all(data, size);
+    }
+
+    struct iovec iov;
+    iov.iov_base = const_cast<unsigned char*>(data);
+    iov.iov_len = size;
+
+    while (iov.iov_len > 0) {
+        auto rc = vmsplice(fd, &iov, 1, 0);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EPIPE) {
+                LOG(ERROR) << "stream reader has gone away";
+                return false;
+            }
+
+            // some drivers' buffers can't be pinned, copy them from now on
+            LOG(WARNING) << "vmsplice() failed, falling back to write(): " << strerror(errno);
+            splice_enabled = false;
+
+            if (not write_all(static_cast<const unsigned char*>(iov.iov_base), iov.iov_len)) {
+                return false;
+            }
+
+            break;
+        }
+
+        spliced = true;
+        stream_size += rc;
+        iov.iov_base = static_cast<unsigned char*>(iov.iov_base) + rc;
+        iov.iov_len -= rc;
+    }
+
+    if (spliced) {
+        PendingBuffer buffer;
+        buffer.index = buffer_index;
+        buffer.stream_offset = stream_size;
+        pending.push_back(buffer);
+    }
+
+    return true;
+}
+
+bool
+StreamWriter::collect_released(std::vector<uint32_t>& released)
+{
+    if (pending.empty()) {
+        return true;
+    }
+
+    int unread = 0;
+    if (ioctl(fd, FIONREAD, &unread) < 0) {
+        LOG(ERROR) << "FIONREAD failed: " << strerror(errno);
+        return false;
+    }
+
+    uint64_t consumed = stream_size - unread;
+    while (not pending.empty() and pending.front().stream_offset <= consumed) {
+        released.push_back(pending.front().index);
+        pending.pop_front();
+    }
+
+    return true;
+}
+
+bool
+StreamWriter::write_header(size_t size)
+{
+    if (format != StreamFormat::LengthPrefixed) {
+        return true;
+    }
+
+    unsigned char header[4];
+    header[0] = (size >> 24) & 0xFF;
+    header[1] = (size >> 16) & 0xFF;
+    header[2] = (size >> 8) & 0xFF;
+    header[3] = size & 0xFF;
+
+    return write_all(header, sizeof(header));
+}
+
+bool
+StreamWriter::write_all(const unsigned char* data, size_t size)
+{
+    while (size > 0) {
+        auto written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG(ERROR) << "writing to stdout failed: " << strerror(errno);
+            return false;
+        }
+        data += written;
+        size -= written;
+        stream_size += written;
+    }
+
+    return true;
+}
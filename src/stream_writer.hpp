@@ -0,0 +1,76 @@
+#ifndef UVCCAPTURE2_STREAM_WRITER_HPP
+#define UVCCAPTURE2_STREAM_WRITER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+enum class StreamFormat {
+    Raw, /* concatenated JPEG images */
+    LengthPrefixed /* every image is preceded by its size as 32-bit big-endian integer */
+};
+
+// Writes a continuous stream of frames to the standard output. When the output
+// is a pipe, frames which live in V4L2 mmap buffers are passed to it with
+// vmsplice(2) without copying; such a buffer must not be given back to the
+// driver until the reader has consumed it, see collect_released().
+//
+// Consumption is inferred from the number of unread bytes in the pipe, which
+// only holds for a reader that read(2)s the pipe. A reader that moves pages out
+// of it with splice(2) or tee(2) may still reference them after that, so the
+// driver could overwrite a frame before it's actually written; such readers
+// need max_held of 0, frames are copied then.
+class StreamWriter
+{
+public:
+    StreamWriter(const StreamWriter&) = delete;
+    StreamWriter() = default;
+
+    ~StreamWriter();
+
+    // Takes over the standard output; from now on the process' stdout (and thus
+    // all logging) goes to stderr so it doesn't get mixed with image data.
+    // At most max_held buffers are kept away from the driver, frames beyond that are copied.
+    bool open_stdout(StreamFormat stream_format, size_t max_held);
+
+    // Copies frame into the stream.
+    bool write_frame(const unsigned char* data, size_t size);
+
+    // Maps frame's pages into the pipe, buffer_index is returned from collect_released()
+    // once the reader has consumed all of them. If spliced is false the frame was copied
+    // and the buffer can be reused immediately.
+    bool splice_frame(const unsigned char* data, size_t size, uint32_t buffer_index, bool& spliced);
+
+    // Same as above for a frame made of a small head, which is copied, and
+    // data in the buffer, e.g. image headers with inserted tables.
+    bool splice_frame(
+        const unsigned char* head, size_t head_size, const unsigned char* data, size_t size, uint32_t buffer_index, bool& spliced);
+
+    // Appends indexes of buffers the reader is done with.
+    bool collect_released(std::vector<uint32_t>& released);
+
+    static bool parse_format(const std::string& name, StreamFormat& stream_format);
+
+private:
+    struct PendingBuffer {
+        uint32_t index;
+        uint64_t stream_offset;
+    };
+
+    int fd = -1;
+    StreamFormat format = StreamFormat::Raw;
+    bool splice_enabled = false;
+    size_t max_held_buffers = 0;
+
+    /* total number of bytes put into the stream */
+    uint64_t stream_size = 0;
+
+    std::deque<PendingBuffer> pending;
+
+    bool write_header(size_t size);
+    bool write_all(const unsigned char* data, size_t size);
+};
+
+#endif
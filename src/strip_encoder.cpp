@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <cstring>
+
+#include "strip_encoder.hpp"
+
+static const unsigned char kMarkerPrefix = 0xFF;
+static const unsigned char kMarkerRST0 = 0xD0;
+static const unsigned char kMarkerRST7 = 0xD7;
+static const unsigned char kMarkerEOI = 0xD9;
+static const int kRestartMarkersCount = 8;
+
+/* jpeg_set_defaults() subsamples chroma 2x2 */
+static const unsigned kRGBMCUHeight = 2 * DCTSIZE;
+
+static void
+start_strip(jpeg_compress_struct& cinfo, JPEGVectorDestination& dest, std::vector<unsigned char>& output, unsigned width, unsigned rows)
+{
+    jpeg_vector_dest(&cinfo, dest, output);
+
+    cinfo.image_width = width;
+    cinfo.image_height = rows;
+    cinfo.input_components = 3;
+}
+
+static void
+set_strip_parameters(jpeg_compress_struct& cinfo, int quality, J_DCT_METHOD dct_method)
+{
+    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+    cinfo.dct_method = dct_method;
+    // all strips have to share Huffman tables
+    cinfo.optimize_coding = FALSE;
+    cinfo.restart_in_rows = 1;
+}
+
+StripEncoder::StripEncoder(unsigned threads_count)
+    : pool(threads_count)
+    , strips(threads_count)
+{
+}
+
+bool
+StripEncoder::encode_rgb(const unsigned char* pixels, unsigned width, unsigned height, int quality, J_DCT_METHOD dct_method,
+    std::vector<unsigned char>& output)
+{
+    auto job = [=](Strip& strip) {
+        struct jpeg_compress_struct cinfo;
+        struct jpeg_error_mgr jerr;
+        JPEGVectorDestination dest;
+
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_compress(&cinfo);
+
+        start_strip(cinfo, dest, strip.data, width, strip.rows);
+        cinfo.in_color_space = JCS_RGB;
+
+        jpeg_set_defaults(&cinfo);
+        set_strip_parameters(cinfo, quality, dct_method);
+        jpeg_start_compress(&cinfo, TRUE);
+
+        auto row_stride = width * 3;
+        while (cinfo.next_scanline < cinfo.image_height) {
+            JSAMPROW row_pointer[1];
+            row_pointer[0] = const_cast<JSAMPROW>(pixels + (strip.first_row + cinfo.next_scanline) * row_stride);
+            jpeg_write_scanlines(&cinfo, row_pointer, 1);
+        }
+
+        jpeg_finish_compress(&cinfo);
+        jpeg_destroy_compress(&cinfo);
+    };
+
+    return encode(height, kRGBMCUHeight, job, output);
+}
+
+bool
+StripEncoder::encode_ycbcr(const YCbCrImage& image, int quality, J_DCT_METHOD dct_method, std::vector<unsigned char>& output)
+{
+    auto job = [&image, quality, dct_method](Strip& strip) {
+        struct jpeg_compress_struct cinfo;
+        struct jpeg_error_mgr jerr;
+        JPEGVectorDestination dest;
+
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_compress(&cinfo);
+
+        start_strip(cinfo, dest, strip.data, image.width, strip.rows);
+        cinfo.in_color_space = JCS_YCbCr;
+
+        jpeg_set_defaults(&cinfo);
+        set_strip_parameters(cinfo, quality, dct_method);
+
+        cinfo.raw_data_in = TRUE;
+        cinfo.comp_info[0].h_samp_factor = image.h_sampling;
+        cinfo.comp_info[0].v_samp_factor = image.v_sampling;
+        for (int i = 1; i < kYCbCrPlanes; i++) {
+            cinfo.comp_info[i].h_samp_factor = 1;
+            cinfo.comp_info[i].v_samp_factor = 1;
+        }
+
+        jpeg_start_compress(&cinfo, TRUE);
+
+        JSAMPROW rows[kYCbCrPlanes][2 * DCTSIZE];
+        JSAMPARRAY planes[kYCbCrPlanes] = { rows[0], rows[1], rows[2] };
+        auto mcu_height = DCTSIZE * image.v_sampling;
+
+        while (cinfo.next_scanline < cinfo.image_height) {
+            auto scanline = strip.first_row + cinfo.next_scanline;
+            for (int plane = 0; plane < kYCbCrPlanes; plane++) {
+                auto count = plane == 0 ? mcu_height : DCTSIZE;
+                auto first = plane == 0 ? scanline : scanline / image.v_sampling;
+                for (unsigned i = 0; i < count; i++) {
+                    rows[plane][i] = const_cast<JSAMPROW>(image.row(plane, first + i));
+                }
+            }
+            jpeg_write_raw_data(&cinfo, planes, mcu_height);
+        }
+
+        jpeg_finish_compress(&cinfo);
+        jpeg_destroy_compress(&cinfo);
+    };
+
+    return encode(image.height, DCTSIZE * image.v_sampling, job, output);
+}
+
+bool
+StripEncoder::encode(unsigned height, unsigned mcu_height, const StripJob& job, std::vector<unsigned char>& output)
+{
+    unsigned mcu_rows = (height + mcu_height - 1) / mcu_height;
+    unsigned count = std::min<unsigned>(strips.size(), mcu_rows);
+
+    for (unsigned i = 0, first = 0; i < count; i++) {
+        // spread MCU rows evenly, the first strips get the remainder
+        unsigned strip_mcu_rows = mcu_rows / count + (i < mcu_rows % count ? 1 : 0);
+        strips[i].first_row = first;
+        strips[i].rows = std::min(strip_mcu_rows * mcu_height, height - first);
+        first += strips[i].rows;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        pending = count;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        auto strip = &strips[i];
+        pool.submit([this, strip, &job] {
+            job(*strip);
+
+            std::lock_guard<std::mutex> lock(done_mutex);
+            if (--pending == 0) {
+                done_cv.notify_one();
+            }
+        });
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait(lock, [this] { return pending == 0; });
+    }
+
+    return stitch(count, height, output);
+}
+
+bool
+StripEncoder::stitch(unsigned count, unsigned height, std::vector<unsigned char>& output)
+{
+    JPEGInfo info;
+    unsigned restart = 0;
+
+    output.clear();
+
+    for (unsigned i = 0; i < count; i++) {
+        const auto& data = strips[i].data;
+
+        if (not parse_jpeg_header(data.data(), data.size(), info)) {
+            return false;
+        }
+
+        if (i == 0) {
+            output.insert(output.end(), data.begin(), data.begin() + info.scan_offset);
+            // the first strip's frame header describes the whole image
+            output[info.sof_offset + 5] = height >> 8;
+            output[info.sof_offset + 6] = height & 0xFF;
+        } else {
+            output.push_back(kMarkerPrefix);
+            output.push_back(kMarkerRST0 + restart++ % kRestartMarkersCount);
+        }
+
+        auto scan_start = output.size();
+        output.insert(output.end(), data.begin() + info.scan_offset, data.begin() + info.scan_offset + info.scan_size);
+
+        // Restart markers of every strip count from zero, continue the sequence instead.
+        auto p = output.data() + scan_start;
+        auto end = output.data() + output.size();
+        while (p + 1 < end) {
+            p = static_cast<unsigned char*>(std::memchr(p, kMarkerPrefix, end - p - 1));
+            if (p == nullptr) {
+                break;
+            }
+            if (p[1] >= kMarkerRST0 and p[1] <= kMarkerRST7) {
+                p[1] = kMarkerRST0 + restart++ % kRestartMarkersCount;
+            }
+            p += 2;
+        }
+    }
+
+    output.push_back(kMarkerPrefix);
+    output.push_back(kMarkerEOI);
+
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef UVCCAPTURE2_STRIP_ENCODER_HPP
+#define UVCCAPTURE2_STRIP_ENCODER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "jpeg_utils.hpp"
+#include "worker_pool.hpp"
+#include "ycbcr_image.hpp"
+
+// Encodes a frame on several threads to cut per-frame latency. The image is
+// split into horizontal strips aligned to MCU rows and every strip is encoded
+// as a separate JPEG with identical tables and a restart marker after each MCU
+// row. Entropy-coded data of the strips is then joined under the headers of
+// the first strip with restart markers renumbered, which gives a baseline JPEG
+// of the whole frame. Huffman tables can't be optimized per frame this way.
+class StripEncoder
+{
+public:
+    StripEncoder(const StripEncoder&) = delete;
+    StripEncoder(unsigned threads_count);
+
+    // Encodes interleaved RGB, 3 bytes per pixel, with 4:2:0 chroma subsampling.
+    bool encode_rgb(const unsigned char* pixels, unsigned width, unsigned height, int quality, J_DCT_METHOD dct_method,
+        std::vector<unsigned char>& output);
+
+    bool encode_ycbcr(const YCbCrImage& image, int quality, J_DCT_METHOD dct_method, std::vector<unsigned char>& output);
+
+private:
+    struct Strip {
+        unsigned first_row = 0;
+        unsigned rows = 0;
+        std::vector<unsigned char> data;
+    };
+
+    using StripJob = std::function<void(Strip& strip)>;
+
+    WorkerPool pool;
+    std::vector<Strip> strips;
+
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    unsigned pending = 0;
+
+    bool encode(unsigned height, unsigned mcu_height, const StripJob& job, std::vector<unsigned char>& output);
+    bool stitch(unsigned count, unsigned height, std::vector<unsigned char>& output);
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "turbojpeg_codec.hpp"
+
+#include <turbojpeg.h>
+
+#include "easylogging++/easylogging++.h"
+
+TurboJPEGCodec::TurboJPEGCodec(const CodecSettings& settings)
+    : quiet(settings.quiet)
+{
+    // TurboJPEG encodes with the fast DCT unless told otherwise
+    flags = settings.profile.dct_method == JDCT_IFAST ? TJFLAG_FASTDCT : TJFLAG_ACCURATEDCT;
+    if (not settings.profile.fancy_upsampling) {
+        flags |= TJFLAG_FASTUPSAMPLE;
+    }
+}
+
+TurboJPEGCodec::~TurboJPEGCodec()
+{
+    if (decompressor != nullptr) {
+        tjDestroy(decompressor);
+    }
+
+    if (compressor != nullptr) {
+        tjDestroy(compressor);
+    }
+}
+
+bool
+TurboJPEGCodec::init()
+{
+    decompressor = tjInitDecompress();
+    compressor = tjInitCompress();
+
+    if (decompressor == nullptr or compressor == nullptr) {
+        LOG(ERROR) << "TurboJPEG initialization failed: " << tjGetErrorStr2(nullptr);
+        return false;
+    }
+
+    return true;
+}
+
+void
+TurboJPEGCodec::reserve(unsigned width, unsigned height)
+{
+    rgb_image.reserve(static_cast<size_t>(width) * height * tjPixelSize[TJPF_RGB]);
+}
+
+void
+TurboJPEGCodec::report_error(void* handle, const char* function)
+{
+    LOG(ERROR) << function << "() failed: " << tjGetErrorStr2(handle);
+}
+
+bool
+TurboJPEGCodec::decoded(int rc, const char* function)
+{
+    if (rc == 0) {
+        return true;
+    }
+
+    if (tjGetErrorCode(decompressor) == TJERR_WARNING) {
+        if (not quiet) {
+            LOG(WARNING) << tjGetErrorStr2(decompressor);
+        }
+        return true;
+    }
+
+    report_error(decompressor, function);
+
+    return false;
+}
+
+bool
+TurboJPEGCodec::decompress(const unsigned char* data, size_t size, unsigned scale_denom, RGBImage& image)
+{
+    int width, height, subsampling, colorspace;
+
+    if (tjDecompressHeader3(decompressor, data, size, &width, &height, &subsampling, &colorspace) < 0) {
+        report_error(decompressor, "tjDecompressHeader3");
+        return false;
+    }
+
+    if (scale_denom > 1) {
+        tjscalingfactor factor = { 1, static_cast<int>(scale_denom) };
+        width = TJSCALED(width, factor);
+        height = TJSCALED(height, factor);
+    }
+
+    auto raw_size = static_cast<size_t>(width) * height * tjPixelSize[TJPF_RGB];
+    // images which weren't sized for the negotiated format grow silently
+    auto reserved = image.capacity > 0;
+    if (image.reserve(raw_size) and reserved) {
+        LOG(INFO) << "frame is larger than the negotiated format, decode buffer has grown to " << raw_size << " bytes";
+    }
+
+    image.width = width;
+    image.height = height;
+
+    auto rc = tjDecompress2(decompressor, data, size, image.raw_data.get(), width, 0, height, TJPF_RGB, flags);
+
+    return decoded(rc, "tjDecompress2");
+}
+
+bool
+TurboJPEGCodec::compress(const RGBImage& image, int quality, std::vector<unsigned char>& output)
+{
+    /* same as jpeg_set_defaults() */
+    int subsampling = TJSAMP_420;
+
+    auto capacity = tjBufSize(image.width, image.height, subsampling);
+    output.resize(capacity);
+
+    auto buffer = output.data();
+    unsigned long jpeg_size = capacity;
+
+    auto rc = tjCompress2(compressor, image.raw_data.get(), image.width, 0, image.height, TJPF_RGB, &buffer, &jpeg_size, subsampling,
+        quality, flags | TJFLAG_NOREALLOC);
+    if (rc < 0) {
+        report_error(compressor, "tjCompress2");
+        return false;
+    }
+
+    output.resize(jpeg_size);
+
+    return true;
+}
+
+bool
+TurboJPEGCodec::recompress(const unsigned char* data, size_t size, int quality, unsigned scale_denom, bool keep_ycbcr,
+    std::vector<unsigned char>& output)
+{
+    int width, height, subsampling, colorspace;
+
+    if (keep_ycbcr) {
+        if (tjDecompressHeader3(decompressor, data, size, &width, &height, &subsampling, &colorspace) < 0) {
+            report_error(decompressor, "tjDecompressHeader3");
+            return false;
+        }
+        keep_ycbcr = colorspace == TJCS_YCbCr;
+    }
+
+    if (not keep_ycbcr) {
+        return decompress(data, size, scale_denom, rgb_image) and compress(rgb_image, quality, output);
+    }
+
+    if (scale_denom > 1) {
+        tjscalingfactor factor = { 1, static_cast<int>(scale_denom) };
+        width = TJSCALED(width, factor);
+        height = TJSCALED(height, factor);
+    }
+
+    // pad of 1 keeps planes tightly packed
+    yuv_image.resize(tjBufSizeYUV2(width, 1, height, subsampling));
+    auto rc = tjDecompressToYUV2(decompressor, data, size, yuv_image.data(), width, 1, height, flags);
+    if (not decoded(rc, "tjDecompressToYUV2")) {
+        return false;
+    }
+
+    auto capacity = tjBufSize(width, height, subsampling);
+    output.resize(capacity);
+
+    auto buffer = output.data();
+    unsigned long jpeg_size = capacity;
+
+    rc = tjCompressFromYUV(
+        compressor, yuv_image.data(), width, 1, height, subsampling, &buffer, &jpeg_size, quality, flags | TJFLAG_NOREALLOC);
+    if (rc < 0) {
+        report_error(compressor, "tjCompressFromYUV");
+        return false;
+    }
+
+    output.resize(jpeg_size);
+
+    return true;
+}
+
+bool
+TurboJPEGCodec::compress(const YCbCrImage& image, int quality, std::vector<unsigned char>& output)
+{
+    int subsampling;
+
+    if (image.h_sampling == 2 and image.v_sampling == 1) {
+        subsampling = TJSAMP_422;
+    } else if (image.h_sampling == 2 and image.v_sampling == 2) {
+        subsampling = TJSAMP_420;
+    } else if (image.h_sampling == 1 and image.v_sampling == 1) {
+        subsampling = TJSAMP_444;
+    } else if (image.h_sampling == 1 and image.v_sampling == 2) {
+        subsampling = TJSAMP_440;
+    } else {
+        LOG(ERROR) << "unsupported chroma subsampling: " << image.h_sampling << "x" << image.v_sampling;
+        return false;
+    }
+
+    const unsigned char* planes[kYCbCrPlanes];
+    int strides[kYCbCrPlanes];
+
+    for (int plane = 0; plane < kYCbCrPlanes; plane++) {
+        planes[plane] = image.row(plane, 0);
+        strides[plane] = image.strides[plane];
+    }
+
+    auto capacity = tjBufSize(image.width, image.height, subsampling);
+    output.resize(capacity);
+
+    auto buffer = output.data();
+    unsigned long jpeg_size = capacity;
+
+    auto rc = tjCompressFromYUVPlanes(
+        compressor, planes, image.width, strides, image.height, subsampling, &buffer, &jpeg_size, quality, flags | TJFLAG_NOREALLOC);
+    if (rc < 0) {
+        report_error(compressor, "tjCompressFromYUVPlanes");
+        return false;
+    }
+
+    output.resize(jpeg_size);
+
+    return true;
+}
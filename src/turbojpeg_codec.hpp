@@ -0,0 +1,49 @@
+#ifndef UVCCAPTURE2_TURBOJPEG_CODEC_HPP
+#define UVCCAPTURE2_TURBOJPEG_CODEC_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "jpeg_codec.hpp"
+
+// Backend built on the TurboJPEG API of libjpeg-turbo. Errors are reported
+// through return codes, so no setjmp()/longjmp() is involved. Output buffers
+// are sized with tjBufSize() up front and reused between frames.
+//
+// Compiled in with -DWITH_TURBOJPEG=ON only. The 2.x API has no counterpart
+// of optimize_coding, so the best profile encodes with the standard tables.
+class TurboJPEGCodec : public JPEGCodec
+{
+public:
+    TurboJPEGCodec(const TurboJPEGCodec&) = delete;
+    TurboJPEGCodec(const CodecSettings& settings);
+
+    ~TurboJPEGCodec();
+
+    bool init();
+
+    bool decompress(const unsigned char* data, size_t size, unsigned scale_denom, RGBImage& image) override;
+    bool compress(const RGBImage& image, int quality, std::vector<unsigned char>& output) override;
+    bool compress(const YCbCrImage& image, int quality, std::vector<unsigned char>& output) override;
+    bool recompress(const unsigned char* data, size_t size, int quality, unsigned scale_denom, bool keep_ycbcr,
+        std::vector<unsigned char>& output) override;
+    void reserve(unsigned width, unsigned height) override;
+
+private:
+    void* decompressor = nullptr;
+    void* compressor = nullptr;
+    /* TJFLAG_* derived from the codec profile */
+    int flags = 0;
+    bool quiet;
+
+    // decoded images, reused between frames
+    RGBImage rgb_image;
+    /* planar YCbCr with the source's subsampling, rows aren't padded */
+    std::vector<unsigned char> yuv_image;
+
+    // Warnings (e.g. a truncated frame) still produce an image.
+    bool decoded(int rc, const char* function);
+    void report_error(void* handle, const char* function);
+};
+
+#endif
@@ -1,25 +1,29 @@
 #include <fcntl.h>
-#include <setjmp.h>
 #include <unistd.h>
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
-#include <linux/limits.h>
 #include <linux/types.h>
 #include <linux/videodev2.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cerrno>
+#include <chrono>
 #include <cmath>
 #include <cstring>
-#include <fstream>
+#include <deque>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -30,61 +34,89 @@
 #include "cxxopts/cxxopts.hpp"
 #include "easylogging++/easylogging++.h"
 
+#include "camera_controls.hpp"
+#include "dct_analyzer.hpp"
+#include "duplicate_filter.hpp"
+#include "file_name_template.hpp"
+#include "frame_synchronizer.hpp"
+#include "frame_stacker.hpp"
+#include "frame_storage.hpp"
+#include "jpeg_codec.hpp"
+#include "jpeg_utils.hpp"
+#include "metrics.hpp"
+#include "motion_detector.hpp"
+#include "rtp_sender.hpp"
+#include "storage_governor.hpp"
+#include "stream_writer.hpp"
+#include "worker_pool.hpp"
+#include "ycbcr_image.hpp"
+
 using OptionsPtr = std::shared_ptr<cxxopts::Options>;
-using MemBufferPtr = std::unique_ptr<unsigned char[]>;
-using EpollEventPtr = std::unique_ptr<struct epoll_event>;
+using RTPJPEGSenderPtr = std::unique_ptr<RTPJPEGSender>;
+using StreamWriterPtr = std::unique_ptr<StreamWriter>;
+using StorageGovernorPtr = std::unique_ptr<StorageGovernor>;
+using MotionDetectorPtr = std::unique_ptr<MotionDetector>;
+using DuplicateFilterPtr = std::unique_ptr<DuplicateFilter>;
+using FrameStackerPtr = std::unique_ptr<FrameStacker>;
 
 static const int kDefaultJPEGQuality = 75;
+static const int kMaxJPEGQuality = 100;
+/* re-encoding a few quality steps down hardly makes a file smaller */
+static const int kReencodeQualityMargin = 5;
 static const int kBuffersCount = 16 * 2;
+/* buffers which always stay queued in the driver, whatever the outputs hold */
+static const int kMinQueuedBuffers = 2;
+/* '--warmup' gives up waiting for exposure after this number of frames unless '--skip' is given */
+static const int kDefaultWarmupMaxFrames = 100;
+static const double kDefaultWarmupTolerance = 2.0;
+/* brightness has to stay within the tolerance for this number of frames in a row */
+static const int kWarmupStableFrames = 3;
+/* frames before motion are kept in capture buffers, some have to stay with the driver */
+static const int kMaxMotionPreFrames = kBuffersCount / 2;
+/* that many exact repeats in a row are reported as a frozen camera */
+static const int kFrozenCameraFrames = 100;
+/* '--skip-duplicates' stores a frame anyway after that many skipped in a row */
+static const int kDefaultDuplicateMaxRun = 300;
+static const char* kStdoutResult = "-";
+static const int kMaxEpollEvents = 16;
 
 INITIALIZE_EASYLOGGINGPP
 
-struct JPEGErrorManager {
-    /* "public" fields */
-    struct jpeg_error_mgr pub;
-    OptionsPtr options;
-    /* for return to caller */
-    jmp_buf setjmp_buffer;
-};
-
-char jpeg_last_error_msg[JMSG_LENGTH_MAX];
-
-void
-jpeg_error_exit_cb(j_common_ptr cinfo)
+bool
+parse_pixel_format(const std::string& name, uint32_t& format)
 {
-    // cinfo->err actually points to a JPEGErrorManager struct
-    JPEGErrorManager* myerr = (JPEGErrorManager*)cinfo->err;
-    // note : *(cinfo->err) is now equivalent to myerr->pub
-
-    // output_message is a method to print an error message
-    // (* (cinfo->err->output_message) ) (cinfo);
-
-    // Create the message
-    myerr->pub.format_message(cinfo, jpeg_last_error_msg);
+    if (name == "mjpeg") {
+        format = V4L2_PIX_FMT_MJPEG;
+    } else if (name == "yuyv") {
+        format = V4L2_PIX_FMT_YUYV;
+    } else if (name == "nv12") {
+        format = V4L2_PIX_FMT_NV12;
+    } else {
+        return false;
+    }
 
-    // Jump to the setjmp point
-    longjmp(myerr->setjmp_buffer, 1);
+    return true;
 }
 
-void
-jpeg_output_message_cb(j_common_ptr cinfo)
-{
-    JPEGErrorManager* error_manager = (JPEGErrorManager*)cinfo->err;
-
-    auto quiet = (*(error_manager->options))["quiet"].as<bool>();
-    if (not quiet) {
-        error_manager->pub.format_message(cinfo, jpeg_last_error_msg);
-        LOG(WARNING) << jpeg_last_error_msg;
-    }
-}
+// Per-camera settings, every camera given with --device gets its own.
+struct DeviceConfig {
+    std::string device;
+    std::string resolution;
+    /* empty if images are only streamed over RTP */
+    std::string result;
+    /* applied in the given order before streaming starts */
+    ControlSettings controls;
+};
 
-class V4L2Device
+class V4L2Device : public SynchronizedSource
 {
 public:
     V4L2Device() = delete;
 
-    V4L2Device(OptionsPtr opts)
-        : options(opts)
+    V4L2Device(OptionsPtr opts, const DeviceConfig& device_config, Metrics& metrics_registry)
+        : config(device_config)
+        , metrics(metrics_registry)
+        , options(opts)
     {
     }
 
@@ -98,118 +130,139 @@ public:
     bool
     initialize()
     {
-        auto initialized = open_device() and check_capabilities() and set_format() and init_buffers();
+        auto initialized = open_device() and check_capabilities() and set_format() and set_frame_rate() and set_camera_quality()
+            and apply_control_settings(fd, config.device, config.controls) and init_buffers() and init_codec() and init_outputs();
 
         return initialized;
     }
 
     bool
-    capture()
+    start()
     {
-        struct v4l2_buffer bufferinfo;
-        bool status = true;
-
         for (int i = 0; i < kBuffersCount; i++) {
-            std::memset(&bufferinfo, 0, sizeof(bufferinfo));
-
-            bufferinfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            bufferinfo.memory = V4L2_MEMORY_MMAP;
-            bufferinfo.index = i; /* Queueing buffer index i. */
-
             // Put the buffer in the incoming queue.
-            if (ioctl(fd, VIDIOC_QBUF, &bufferinfo) < 0) {
-                LOG(ERROR) << "VIDIOC_QBUF failed: " << strerror(errno);
+            if (not queue_buffer(i)) {
                 return false;
             }
         }
 
         // Activate streaming
-        int type = bufferinfo.type;
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         if (ioctl(fd, VIDIOC_STREAMON, &type) < 0) {
             LOG(ERROR) << "VIDIOC_STREAMON failed: " << strerror(errno);
             return false;
         }
 
-        auto efd = epoll_create(100);
-        if (efd == -1) {
-            LOG(ERROR) << "epoll_create() failed: " << strerror(errno);
-            return false;
-        }
-
-        struct epoll_event event;
-        std::memset(&event, 0, sizeof(event));
-
-        event.data.fd = fd;
-        event.events = EPOLLIN | EPOLLET;
-
-        auto rc = epoll_ctl(efd, EPOLL_CTL_ADD, fd, &event);
-        if (rc == -1) {
-            LOG(ERROR) << "epoll_ctl() failed: " << strerror(errno);
-            return false;
+        loop = (*options)["loop"].as<bool>();
+        ignore_jpeg_errors = (*options)["ignore-jpeg-errors"].as<bool>();
+        raw_ycbcr = (*options)["raw-ycbcr"].as<bool>();
+        validate_frames = (*options)["validate"].as<bool>() and pixel_format == V4L2_PIX_FMT_MJPEG;
+        skip_reencode = (*options)["skip-reencode"].as<bool>() and pixel_format == V4L2_PIX_FMT_MJPEG;
+        frames_count = options->count("count") ? (*options)["count"].as<int>() : 1;
+        frames_to_skip = options->count("skip") ? (*options)["skip"].as<int>() : 0;
+        warmup = (*options)["warmup"].as<bool>() and pixel_format == V4L2_PIX_FMT_MJPEG;
+        if (warmup) {
+            if (options->count("skip") == 0) {
+                frames_to_skip = kDefaultWarmupMaxFrames;
+            }
         }
+        pause = std::lround((options->count("pause") ? (*options)["pause"].as<double>() : 0) * 1e6);
 
-        EpollEventPtr events = EpollEventPtr(new struct epoll_event);
-
-        int frames_skipped = 0;
-
-        auto loop = (*options)["loop"].as<bool>();
-        auto ignore_jpeg_errors = (*options)["ignore-jpeg-errors"].as<bool>();
-        int frames_count = options->count("count") ? (*options)["count"].as<int>() : 1;
-        int frames_to_skip = options->count("skip") ? (*options)["skip"].as<int>() : 0;
-        useconds_t pause = std::lround((options->count("pause") ? (*options)["pause"].as<double>() : 0) * 1e6);
-
-        while ((frames_taken < frames_count) or loop) {
-            auto rc = epoll_wait(efd, events.get(), 1, -1);
-            if (rc == -1) {
-                LOG(ERROR) << "epoll_wait() error: " << strerror(errno);
-                status = false;
-                break;
-            }
+        return true;
+    }
 
-            if (rc == 0) {
-                LOG(WARNING) << "epoll_wait() returned 0";
-                continue;
-            }
+    // Handles all frames the driver has ready, is called once the device's fd
+    // becomes readable. Calls for the same device must not overlap.
+    bool
+    process_frames()
+    {
+        struct v4l2_buffer bufferinfo;
 
-            if ((events->events & EPOLLERR) or (events->events & EPOLLHUP) or (!(events->events & EPOLLIN))) {
-                LOG(ERROR) << "epoll error";
-                status = false;
-                break;
-            }
+        while (not finished()) {
+            std::memset(&bufferinfo, 0, sizeof(bufferinfo));
+            bufferinfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            bufferinfo.memory = V4L2_MEMORY_MMAP;
 
             // Dequeue the buffer.
             if (ioctl(fd, VIDIOC_DQBUF, &bufferinfo) < 0) {
-                LOG(ERROR) << "VIDIOC_QBUF failed: " << strerror(errno);
-                status = false;
-                break;
+                if (errno == EAGAIN) {
+                    break;
+                }
+                LOG(ERROR) << "VIDIOC_DQBUF failed: " << strerror(errno);
+                return false;
             }
 
             bool skip_frame = frames_to_skip > 0 and frames_skipped < frames_to_skip;
+            if (skip_frame and warmup and exposure_settled(bufferinfo)) {
+                frames_to_skip = frames_skipped;
+                skip_frame = false;
+            }
+            bool corrupt_frame = not skip_frame and validate_frames and not frame_valid(bufferinfo);
+            bool drop_frame = not skip_frame and not corrupt_frame and not synchronizer and governor and governor->drop_frame();
+            bool buffer_held = false;
             bool ok = false;
 
-            if (not skip_frame) {
-                ok = write_jpeg(bufferinfo);
+            if (corrupt_frame) {
+                // counted in frame_valid(), the capture goes on with the next frame
+            } else if (drop_frame) {
+                metrics.increment("frames_dropped_by_governor");
+            } else if (not skip_frame and synchronizer) {
+                // the synchronizer gives the buffer back once the frame is written or dropped
+                buffer_held = true;
+                ok = synchronizer->submit(synchronizer_source, bufferinfo);
                 if (not ok) {
-                    if (not ignore_jpeg_errors) {
-                        status = false;
-                        break;
+                    return false;
+                }
+            } else if (not skip_frame and motion_detector and not motion_detected(bufferinfo)) {
+                if (not hold_pre_motion_frame(bufferinfo, buffer_held)) {
+                    return false;
+                }
+            } else if (not skip_frame and duplicate_filter and duplicate_frame(bufferinfo)) {
+                // counted in duplicate_frame()
+            } else if (not skip_frame) {
+                struct timespec now;
+                clock_gettime(CLOCK_REALTIME, &now);
+
+                if (not write_pre_motion_frames()) {
+                    return false;
+                }
+
+                if (frame_stacker) {
+                    if (not add_stacked_frame(bufferinfo, now, ok)) {
+                        return false;
+                    }
+                } else if (burst_size > 1) {
+                    if (not add_burst_frame(bufferinfo, now, ok, buffer_held)) {
+                        return false;
                     }
                 } else {
-                    frames_taken++;
+                    ok = write_frame(bufferinfo, now, buffer_held);
+                    if (not ok and not ignore_jpeg_errors) {
+                        return false;
+                    }
                 }
             } else {
                 frames_skipped++;
+                if (warmup and frames_skipped == frames_to_skip) {
+                    LOG(WARNING) << config.device << ": exposure hasn't settled within " << frames_to_skip << " frames";
+                }
             }
 
-            bufferinfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            bufferinfo.memory = V4L2_MEMORY_MMAP;
-            /* Set the index if using several buffers */
+            // Queue the next one, unless its pages are still referenced by the output pipe.
+            if (not buffer_held and not queue_buffer(bufferinfo.index)) {
+                return false;
+            }
 
-            // Queue the next one.
-            if (ioctl(fd, VIDIOC_QBUF, &bufferinfo) < 0) {
-                LOG(ERROR) << "VIDIOC_QBUF failed: " << strerror(errno);
-                status = false;
-                break;
+            if (stream_writer) {
+                released_buffers.clear();
+                if (not stream_writer->collect_released(released_buffers)) {
+                    return false;
+                }
+                for (auto index : released_buffers) {
+                    if (not queue_buffer(index)) {
+                        return false;
+                    }
+                }
             }
 
             if (pause > 0 and (not skip_frame) and ok) {
@@ -217,13 +270,68 @@ public:
             }
         }
 
+        return true;
+    }
+
+    void
+    set_synchronizer(FrameSynchronizer* frame_synchronizer, size_t source)
+    {
+        synchronizer = frame_synchronizer;
+        synchronizer_source = source;
+    }
+
+    bool
+    write_synchronized(const struct v4l2_buffer& bufferinfo, uint64_t counter, const struct timespec& timestamp) override
+    {
+        bool buffer_held = false;
+
+        if (not write_jpeg(bufferinfo, counter, timestamp, buffer_held)) {
+            metrics.increment("frames_failed");
+            return ignore_jpeg_errors;
+        }
+
+        metrics.increment("frames_written");
+        frames_taken++;
+
+        return true;
+    }
+
+    bool
+    release_buffer(uint32_t index) override
+    {
+        return queue_buffer(index);
+    }
+
+    bool
+    finished() const
+    {
+        return (frames_taken >= frames_count) and not loop;
+    }
+
+    bool
+    stop()
+    {
         // Deactivate streaming
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         if (ioctl(fd, VIDIOC_STREAMOFF, &type) < 0) {
             LOG(ERROR) << "VIDIOC_STREAMOFF failed: " << strerror(errno);
             return false;
         }
 
-        return status;
+        // make sure files waiting for a group commit hit the disk
+        return storage.flush();
+    }
+
+    int
+    descriptor() const
+    {
+        return fd;
+    }
+
+    const std::string&
+    name() const
+    {
+        return config.device;
     }
 
 private:
@@ -247,42 +355,114 @@ private:
         size_t size = 0;
     };
 
-    class RawImage
-    {
-    public:
-        RawImage() = default;
-        RawImage(RawImage&) = delete;
-
-        RawImage(RawImage&& other)
-            : raw_data(std::move(other.raw_data))
-            , width(other.width)
-            , height(other.height)
-        {
-            other.width = 0;
-            other.height = 0;
-        }
-
-        MemBufferPtr raw_data;
-
-        unsigned int width = 0;
-        unsigned int height = 0;
+    // Dequeued buffer waiting to be written.
+    struct PendingFrame {
+        struct v4l2_buffer bufferinfo;
+        struct timespec timestamp;
     };
 
-    using RawImagePtr = std::unique_ptr<RawImage>;
-
     int fd = -1;
-    int frames_taken = 0;
+    /* is also updated by the synchronizer on behalf of other devices' workers */
+    std::atomic<int> frames_taken { 0 };
+    int frames_skipped = 0;
+
+    bool loop = false;
+    bool ignore_jpeg_errors = false;
+    bool validate_frames = false;
+    bool skip_reencode = false;
+    /* compression quality the camera has agreed to, 0 - not controlled */
+    int camera_quality = 0;
+    uint64_t source_quant_hash = 0;
+    int source_quality_estimate = 0;
+    bool raw_ycbcr = false;
+    JPEGCodecPtr codec;
+    int frames_count = 1;
+    int frames_to_skip = 0;
+    bool warmup = false;
+    double warmup_luma = 0;
+    int warmup_stable_frames = 0;
+    useconds_t pause = 0;
+
+    DeviceConfig config;
+
+    /* format the driver has agreed to */
+    uint32_t pixel_format = 0;
+    uint32_t frame_width = 0;
+    uint32_t frame_height = 0;
+    uint32_t frame_size_image = 0;
+    uint32_t frame_bytes_per_line = 0;
 
     std::array<IOBuffer, kBuffersCount> buffers;
 
+    // decoded and re-encoded images, reused between frames
+    RGBImage decoded_image;
+    YCbCrImage ycbcr_image;
+    std::vector<unsigned char> jpeg_buffer;
+
+    /* reads DC coefficients for '--warmup', '--motion' and '--skip-duplicates' */
+    DCTAnalyzer dct_analyzer;
+    bool dct_analyzed = false;
+    uint32_t dct_analyzed_sequence = 0;
+    DuplicateFilterPtr duplicate_filter;
+    int exact_duplicates_in_row = 0;
+    /* exact and similar frames skipped since the last stored one */
+    int duplicates_in_row = 0;
+    int max_duplicates_in_row = kDefaultDuplicateMaxRun;
+    FrameStackerPtr frame_stacker;
+    int stack_size = 1;
+    int burst_size = 1;
+    int burst_frames = 0;
+    double burst_sharpness = 0;
+    /* sharpest frame of the current burst, its buffer is held */
+    PendingFrame burst_best;
+    MotionDetectorPtr motion_detector;
+    int motion_pre_frames = 0;
+    int motion_post_frames = 0;
+    int motion_post_frames_left = 0;
+    /* frames before motion, their buffers are held until motion starts or they get too old */
+    std::deque<PendingFrame> pre_motion_frames;
+
+    FileNameTemplate file_name_template;
+    std::string jpeg_file_name;
+    FrameStorage storage;
+    StorageGovernorPtr governor;
+
+    std::vector<uint32_t> released_buffers;
+
+    FrameSynchronizer* synchronizer = nullptr;
+    size_t synchronizer_source = 0;
+
+    Metrics& metrics;
+
+    RTPJPEGSenderPtr rtp_sender;
+    StreamWriterPtr stream_writer;
+
     OptionsPtr options;
 
+    bool
+    queue_buffer(uint32_t index)
+    {
+        struct v4l2_buffer bufferinfo;
+        std::memset(&bufferinfo, 0, sizeof(bufferinfo));
+
+        bufferinfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        bufferinfo.memory = V4L2_MEMORY_MMAP;
+        bufferinfo.index = index;
+
+        if (ioctl(fd, VIDIOC_QBUF, &bufferinfo) < 0) {
+            LOG(ERROR) << "VIDIOC_QBUF failed: " << strerror(errno);
+            return false;
+        }
+
+        return true;
+    }
+
     bool
     open_device()
     {
         if (fd == -1) {
-            auto device = (*options)["device"].as<std::string>().c_str();
-            fd = open(device, O_RDWR);
+            auto device = config.device.c_str();
+            fd = open(device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
             if (fd < 0) {
                 LOG(ERROR) << "Couldn't open '" << device << "': " << strerror(errno);
                 return false;
@@ -329,276 +509,1341 @@ private:
         format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
         bool ok;
 
-        std::tie(ok, format.fmt.pix.width, format.fmt.pix.height) = parse_resolution();
+        std::string format_name = "mjpeg";
+        if (options->count("format")) {
+            format_name = (*options)["format"].as<std::string>();
+            if (not parse_pixel_format(format_name, format.fmt.pix.pixelformat)) {
+                LOG(ERROR) << "invalid value for '--format' parameter: " << format_name;
+                return false;
+            }
+        }
+
+        auto requested_format = format.fmt.pix.pixelformat;
+
+        uint32_t width, height;
+        std::tie(ok, width, height) = parse_resolution();
 
         if (not ok) {
             return false;
         }
 
-        if (ioctl(fd, VIDIOC_S_FMT, &format) < 0) {
-            LOG(ERROR) << "VIDIOC_S_FMT failed: " << strerror(errno);
+        if ((*options)["nearest-resolution"].as<bool>() and not find_frame_size(format.fmt.pix.pixelformat, width, height)) {
             return false;
         }
 
-        return true;
-    }
-
-    bool
-    init_buffers()
-    {
-        struct v4l2_requestbuffers bufrequest;
-        std::memset(&bufrequest, 0, sizeof(bufrequest));
-
-        bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        bufrequest.memory = V4L2_MEMORY_MMAP;
-        bufrequest.count = kBuffersCount;
+        format.fmt.pix.width = width;
+        format.fmt.pix.height = height;
 
-        if (ioctl(fd, VIDIOC_REQBUFS, &bufrequest) < 0) {
-            LOG(ERROR) << "VIDIOC_REQBUFS failed: " << strerror(errno);
+        if (ioctl(fd, VIDIOC_S_FMT, &format) < 0) {
+            LOG(ERROR) << "VIDIOC_S_FMT failed: " << strerror(errno);
             return false;
         }
 
-        struct v4l2_buffer bufferinfo;
-
-        for (int i = 0; i < kBuffersCount; i++) {
-            std::memset(&bufferinfo, 0, sizeof(bufferinfo));
-
-            bufferinfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            bufferinfo.memory = V4L2_MEMORY_MMAP;
-            bufferinfo.index = i;
-
-            if (ioctl(fd, VIDIOC_QUERYBUF, &bufferinfo) < 0) {
-                LOG(ERROR) << "VIDIOC_QUERYBUF failed: " << strerror(errno);
-                return false;
-            }
+        // The driver is free to adjust any of the requested parameters, what it
+        // has written back is what the frames are going to look like.
+        if (format.fmt.pix.pixelformat != requested_format) {
+            LOG(ERROR) << config.device << " doesn't support " << format_name << " format";
+            return false;
+        }
 
-            buffers[i].start = mmap(NULL, bufferinfo.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, bufferinfo.m.offset);
-            if (buffers[i].start == MAP_FAILED) {
-                LOG(ERROR) << "mmaping buffer failed: " << strerror(errno);
-                return false;
-            }
+        if (format.fmt.pix.width == 0 or format.fmt.pix.height == 0) {
+            LOG(ERROR) << config.device << " has negotiated invalid resolution " << format.fmt.pix.width << "x" << format.fmt.pix.height;
+            return false;
+        }
 
-            buffers[i].size = bufferinfo.length;
+        if (format.fmt.pix.width != width or format.fmt.pix.height != height) {
+            LOG(WARNING) << config.device << " captures at " << format.fmt.pix.width << "x" << format.fmt.pix.height << " instead of "
+                         << width << "x" << height;
         }
 
+        pixel_format = format.fmt.pix.pixelformat;
+        frame_width = format.fmt.pix.width;
+        frame_height = format.fmt.pix.height;
+        frame_size_image = format.fmt.pix.sizeimage;
+        frame_bytes_per_line = format.fmt.pix.bytesperline;
+
         return true;
     }
 
-    std::tuple<bool, uint32_t, uint32_t>
-    parse_resolution()
+    // Replaces width and height with the closest frame size the device supports.
+    bool
+    find_frame_size(uint32_t format, uint32_t& width, uint32_t& height)
     {
-        uint32_t x = 0, y = 0;
-        bool ok = true;
+        struct v4l2_frmsizeenum frmsize;
+        std::memset(&frmsize, 0, sizeof(frmsize));
 
-        auto resolution = (*options)["resolution"].as<std::string>();
-        auto delimeter = resolution.find("x");
+        frmsize.pixel_format = format;
 
-        if ((delimeter != std::string::npos) and (delimeter + 1 < resolution.size())) {
-            auto x_str = resolution.substr(0, delimeter);
-            auto y_str = resolution.substr(delimeter + 1, resolution.size() - 1);
+        uint64_t best_distance = UINT64_MAX;
+        uint32_t best_width = 0, best_height = 0;
 
-            try {
-                x = std::stoul(x_str);
-                y = std::stoul(y_str);
-            } catch (std::invalid_argument& exc) {
-                LOG(ERROR) << "no conversion could be performed: " << exc.what();
-                ok = false;
-            } catch (std::out_of_range& exc) {
-                LOG(ERROR) << "out of range error: " << exc.what();
-                ok = false;
+        // nearest value on the min + k * step grid, max itself isn't necessarily on it
+        auto snap = [](uint32_t value, uint32_t min, uint32_t max, uint32_t step) {
+            value = std::min(std::max(value, min), max);
+            if (step > 1) {
+                value = min + (value - min + step / 2) / step * step;
+                if (value > max) {
+                    value -= step;
+                }
             }
-        } else {
-            LOG(ERROR) << "invalid resolution description: " << resolution;
-            ok = false;
-        }
-
-        return std::make_tuple(ok, x, y);
-    }
+            return value;
+        };
+
+        auto consider = [&](uint32_t w, uint32_t h) {
+            auto dw = static_cast<int64_t>(w) - width;
+            auto dh = static_cast<int64_t>(h) - height;
+            uint64_t distance = dw * dw + dh * dh;
+            if (distance < best_distance) {
+                best_distance = distance;
+                best_width = w;
+                best_height = h;
+            }
+        };
 
-    std::string
-    make_jpeg_file_name()
-    {
-        char name[PATH_MAX];
-        int rc = 0;
+        while (ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frmsize) == 0) {
+            if (frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+                consider(frmsize.discrete.width, frmsize.discrete.height);
+            } else {
+                const auto& sw = frmsize.stepwise;
+                auto w = snap(width, sw.min_width, sw.max_width, sw.step_width);
+                auto h = snap(height, sw.min_height, sw.max_height, sw.step_height);
+                consider(w, h);
+                break;
+            }
+            frmsize.index++;
+        }
 
-        auto tmpl = (*options)["result"].as<std::string>();
+        if (best_distance == UINT64_MAX) {
+            LOG(ERROR) << config.device << " doesn't enumerate its frame sizes";
+            return false;
+        }
 
-        auto use_strftime = (*options)["strftime"].as<bool>();
-        if (use_strftime) {
-            struct tm lt;
-            auto t = std::time(nullptr);
-            if (localtime_r(&t, &lt) == nullptr) {
-                LOG(ERROR) << "localtime_r() failed";
-            }
-            rc = strftime(name, sizeof(name) - 1, tmpl.c_str(), &lt);
-        } else {
-            rc = snprintf(name, sizeof(name) - 1, tmpl.c_str(), frames_taken);
+        if (best_width != width or best_height != height) {
+            LOG(INFO) << config.device << ": using nearest supported resolution " << best_width << "x" << best_height << " for requested "
+                      << width << "x" << height;
         }
 
-        return (rc > 0 ? std::string(name) : std::string());
+        width = best_width;
+        height = best_height;
+
+        return true;
     }
 
     bool
-    write_jpeg(const struct v4l2_buffer& bufferinfo)
+    set_frame_rate()
     {
-        auto idx = bufferinfo.index;
+        if (options->count("fps") == 0) {
+            return true;
+        }
 
-        auto jpeg_file_name = make_jpeg_file_name();
-        if (jpeg_file_name.empty()) {
-            LOG(ERROR) << "couldn't create result file name";
+        auto fps = (*options)["fps"].as<double>();
+        if (fps <= 0) {
+            LOG(ERROR) << "invalid value for '--fps' parameter: " << fps;
             return false;
         }
 
-        auto save_jpeg_asis = (*options)["save-jpeg-asis"].as<bool>();
-        if (save_jpeg_asis) { // store jpeg as we have received it from the camera
-            std::fstream result(jpeg_file_name, std::ios::binary | std::ios::out | std::ios::trunc);
-            if (result.fail()) {
-                LOG(ERROR) << "open file failed: " << strerror(errno);
-                return false;
-            }
+        struct v4l2_fract interval;
+        if (not find_frame_interval(fps, interval)) {
+            return false;
+        }
 
-            try {
-                result.write(static_cast<const char*>(buffers[idx].start), bufferinfo.length);
-            } catch (std::exception& exc) {
-                LOG(ERROR) << "write file failed: " << exc.what();
-                return false;
-            }
+        struct v4l2_streamparm parm;
+        std::memset(&parm, 0, sizeof(parm));
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
-            return true;
+        if (ioctl(fd, VIDIOC_G_PARM, &parm) < 0) {
+            LOG(ERROR) << "VIDIOC_G_PARM failed: " << strerror(errno);
+            return false;
         }
 
-        // (Re)compress JPEG
-
-        bool ok;
-        RawImagePtr image;
+        if ((parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME) == 0) {
+            LOG(ERROR) << config.device << " doesn't support frame rate selection";
+            return false;
+        }
 
-        try {
-            std::tie(ok, image) = decompress_jpeg(bufferinfo);
-            if (not ok) {
-                LOG(ERROR) << "image decompression failed!";
-                return false;
-            }
+        parm.parm.capture.timeperframe = interval;
 
-            ok = compress_jpeg(image, jpeg_file_name);
-            if (not ok) {
-                LOG(ERROR) << "image compression failed!";
-                return false;
-            }
-        } catch (std::exception& exc) {
-            LOG(WARNING) << "image (de)compression failed: " << exc.what();
+        if (ioctl(fd, VIDIOC_S_PARM, &parm) < 0) {
+            LOG(ERROR) << "VIDIOC_S_PARM failed: " << strerror(errno);
             return false;
         }
 
+        const auto& actual = parm.parm.capture.timeperframe;
+        // drivers reduce the fraction, compare values
+        uint64_t actual_scaled = static_cast<uint64_t>(actual.numerator) * interval.denominator;
+        uint64_t requested_scaled = static_cast<uint64_t>(actual.denominator) * interval.numerator;
+        if (actual_scaled != requested_scaled) {
+            LOG(WARNING) << config.device << " runs at " << actual.denominator << "/" << actual.numerator << " fps instead of "
+                         << interval.denominator << "/" << interval.numerator;
+        }
+
         return true;
     }
 
-    std::tuple<bool, RawImagePtr>
-    decompress_jpeg(const struct v4l2_buffer& bufferinfo)
+    // Moves compression to the camera's hardware encoder, frames are then
+    // stored as is unless the governor asks for lower quality or resolution.
+    bool
+    set_camera_quality()
     {
-        struct jpeg_decompress_struct cinfo;
-        RawImagePtr image;
-
-        JPEGErrorManager jerr;
-        jerr.options = options;
-        cinfo.err = jpeg_std_error(&jerr.pub);
-        jerr.pub.error_exit = jpeg_error_exit_cb;
-        jerr.pub.output_message = jpeg_output_message_cb;
-
-        if (setjmp(jerr.setjmp_buffer)) {
-            // If we get here, the JPEG code has signaled an error.
-            auto quiet = (*options)["quiet"].as<bool>();
-            if (not quiet) {
-                LOG(WARNING) << jpeg_last_error_msg;
-            }
-
-            jpeg_destroy_decompress(&cinfo);
-
-            return std::make_tuple(false, std::move(image));
+        if (not(*options)["camera-quality"].as<bool>() or pixel_format != V4L2_PIX_FMT_MJPEG) {
+            return true;
         }
 
-        jpeg_create_decompress(&cinfo);
-
-        auto idx = bufferinfo.index;
-        jpeg_mem_src(&cinfo, static_cast<unsigned char*>(buffers[idx].start), bufferinfo.length);
+        struct v4l2_queryctrl queryctrl;
+        std::memset(&queryctrl, 0, sizeof(queryctrl));
+        queryctrl.id = V4L2_CID_JPEG_COMPRESSION_QUALITY;
 
-        auto rc = jpeg_read_header(&cinfo, TRUE);
-        if (rc != 1) {
-            LOG(ERROR) << "broken JPEG";
-            return std::make_tuple(false, std::move(image));
+        if (ioctl(fd, VIDIOC_QUERYCTRL, &queryctrl) < 0 or (queryctrl.flags & V4L2_CTRL_FLAG_DISABLED)) {
+            LOG(INFO) << config.device << " doesn't support compression quality control, images are re-encoded";
+            return true;
         }
 
-        jpeg_start_decompress(&cinfo);
+        int quality = options->count("quality") ? (*options)["quality"].as<int>() : kDefaultJPEGQuality;
 
-        auto width = cinfo.output_width;
-        auto height = cinfo.output_height;
-        auto pixel_size = cinfo.output_components;
-        auto row_stride = width * pixel_size;
-        auto raw_size = width * height * pixel_size;
+        struct v4l2_control control;
+        std::memset(&control, 0, sizeof(control));
+        control.id = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+        control.value = std::min(std::max(quality, queryctrl.minimum), queryctrl.maximum);
 
-        image = RawImagePtr(new RawImage);
-
-        image->raw_data = MemBufferPtr(new unsigned char[raw_size]);
-        image->width = width;
-        image->height = height;
+        if (ioctl(fd, VIDIOC_S_CTRL, &control) < 0) {
+            LOG(WARNING) << "setting compression quality of " << config.device << " failed: " << strerror(errno);
+            return true;
+        }
 
-        while (cinfo.output_scanline < cinfo.output_height) {
-            unsigned char* buffer_array[1];
-            buffer_array[0] = image->raw_data.get() + (cinfo.output_scanline) * row_stride;
-            jpeg_read_scanlines(&cinfo, buffer_array, 1);
+        if (ioctl(fd, VIDIOC_G_CTRL, &control) < 0) {
+            LOG(ERROR) << "VIDIOC_G_CTRL failed: " << strerror(errno);
+            return false;
         }
 
-        jpeg_finish_decompress(&cinfo);
-        jpeg_destroy_decompress(&cinfo);
+        camera_quality = control.value;
+        if (camera_quality != quality) {
+            LOG(WARNING) << config.device << " compresses at quality " << camera_quality << " instead of " << quality;
+        }
 
-        return std::make_tuple(true, std::move(image));
+        return true;
     }
 
+    // Picks the frame interval closest to the requested frame rate among the ones
+    // the camera supports for the negotiated format.
     bool
-    compress_jpeg(const RawImagePtr& image, const std::string& jpeg_file_name)
+    find_frame_interval(double fps, struct v4l2_fract& interval)
     {
-        struct jpeg_compress_struct cinfo;
-        struct jpeg_error_mgr jerr;
+        struct v4l2_frmivalenum frmival;
+        std::memset(&frmival, 0, sizeof(frmival));
 
-        JSAMPROW row_pointer[1];
+        frmival.pixel_format = pixel_format;
+        frmival.width = frame_width;
+        frmival.height = frame_height;
 
-        cinfo.err = jpeg_std_error(&jerr);
-        jpeg_create_compress(&cinfo);
+        // fall back to the plain requested value if the driver can't enumerate intervals
+        interval.numerator = 1000;
+        interval.denominator = std::lround(fps * 1000);
 
-        FILE* outfile = fopen(jpeg_file_name.c_str(), "wb");
-        if (outfile == nullptr) {
-            LOG(ERROR) << "can't open '" << jpeg_file_name << "': " << strerror(errno);
-            return false;
+        if (ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &frmival) < 0) {
+            LOG(WARNING) << "VIDIOC_ENUM_FRAMEINTERVALS failed, requesting " << fps << " fps as is: " << strerror(errno);
+            return true;
         }
 
-        jpeg_stdio_dest(&cinfo, outfile);
+        if (frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+            double best_distance = -1;
+            std::ostringstream supported;
 
-        cinfo.image_width = image->width; /* image width and height, in pixels */
-        cinfo.image_height = image->height;
-        cinfo.input_components = 3; /* # of color components per pixel */
-        cinfo.in_color_space = JCS_RGB; /* colorspace of input image */
+            do {
+                const auto& discrete = frmival.discrete;
+                if (discrete.numerator != 0) {
+                    double rate = static_cast<double>(discrete.denominator) / discrete.numerator;
+                    double distance = std::fabs(rate - fps);
 
-        jpeg_set_defaults(&cinfo);
+                    supported << " " << rate;
 
+                    if (best_distance < 0 or distance < best_distance) {
+                        best_distance = distance;
+                        interval = discrete;
+                    }
+                }
+
+                frmival.index++;
+            } while (ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &frmival) == 0);
+
+            if (best_distance < 0) {
+                LOG(ERROR) << config.device << " reported no usable frame intervals";
+                return false;
+            }
+
+            if (best_distance > 0.01) {
+                LOG(WARNING) << fps << " fps isn't supported by " << config.device << " (supported:" << supported.str() << "), using "
+                             << static_cast<double>(interval.denominator) / interval.numerator;
+            }
+
+            return true;
+        }
+
+        // stepwise and continuous ranges, min is the shortest interval i.e. the highest rate
+        const auto& sw = frmival.stepwise;
+        if (sw.min.numerator == 0 or sw.max.numerator == 0) {
+            LOG(WARNING) << config.device << " reported an invalid frame interval range, requesting " << fps << " fps as is";
+            return true;
+        }
+
+        double max_fps = static_cast<double>(sw.min.denominator) / sw.min.numerator;
+        double min_fps = static_cast<double>(sw.max.denominator) / sw.max.numerator;
+
+        if (fps > max_fps or fps < min_fps) {
+            auto clamped = std::min(std::max(fps, min_fps), max_fps);
+            LOG(WARNING) << fps << " fps is out of the range supported by " << config.device << " (" << min_fps << " - " << max_fps
+                         << "), using " << clamped;
+            interval.denominator = std::lround(clamped * 1000);
+        }
+
+        return true;
+    }
+
+    bool
+    init_buffers()
+    {
+        struct v4l2_requestbuffers bufrequest;
+        std::memset(&bufrequest, 0, sizeof(bufrequest));
+
+        bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        bufrequest.memory = V4L2_MEMORY_MMAP;
+        bufrequest.count = kBuffersCount;
+
+        if (ioctl(fd, VIDIOC_REQBUFS, &bufrequest) < 0) {
+            LOG(ERROR) << "VIDIOC_REQBUFS failed: " << strerror(errno);
+            return false;
+        }
+
+        struct v4l2_buffer bufferinfo;
+
+        for (int i = 0; i < kBuffersCount; i++) {
+            std::memset(&bufferinfo, 0, sizeof(bufferinfo));
+
+            bufferinfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            bufferinfo.memory = V4L2_MEMORY_MMAP;
+            bufferinfo.index = i;
+
+            if (ioctl(fd, VIDIOC_QUERYBUF, &bufferinfo) < 0) {
+                LOG(ERROR) << "VIDIOC_QUERYBUF failed: " << strerror(errno);
+                return false;
+            }
+
+            buffers[i].start = mmap(NULL, bufferinfo.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, bufferinfo.m.offset);
+            if (buffers[i].start == MAP_FAILED) {
+                LOG(ERROR) << "mmaping buffer failed: " << strerror(errno);
+                return false;
+            }
+
+            buffers[i].size = bufferinfo.length;
+
+            if (bufferinfo.length < frame_size_image) {
+                LOG(WARNING) << config.device << ": buffer " << i << " is " << bufferinfo.length << " bytes long, "
+                             << frame_size_image << " bytes were negotiated";
+            }
+        }
+
+        // Size decode and encode buffers from the negotiated format so that the
+        // steady state doesn't allocate.
+        if (pixel_format != V4L2_PIX_FMT_MJPEG) {
+            ycbcr_image.resize(frame_width, frame_height, 2, pixel_format == V4L2_PIX_FMT_NV12 ? 2 : 1);
+        }
+        jpeg_buffer.reserve(std::max<size_t>(frame_size_image, kInitialJPEGBufferSize));
+
+        return true;
+    }
+
+    bool
+    init_codec()
+    {
+        if (pixel_format != V4L2_PIX_FMT_MJPEG and (*options)["save-jpeg-asis"].as<bool>()) {
+            LOG(ERROR) << "'--save-jpeg-asis' requires MJPEG format";
+            return false;
+        }
+
+        CodecSettings settings;
+        settings.quiet = (*options)["quiet"].as<bool>();
+
+        if (options->count("speed")) {
+            auto name = (*options)["speed"].as<std::string>();
+            if (not parse_codec_profile(name, settings.profile)) {
+                LOG(ERROR) << "invalid value for '--speed' parameter: " << name;
+                return false;
+            }
+        }
+
+        if (settings.profile.optimize_coding and options->count("rtp")) {
+            LOG(INFO) << "optimized Huffman tables can't be sent over RTP, '--rtp' uses standard ones";
+            settings.profile = rtp_codec_profile(settings.profile);
+        }
+
+        if (options->count("encoder-strips")) {
+            auto strips = (*options)["encoder-strips"].as<int>();
+            if (strips <= 0) {
+                LOG(ERROR) << "invalid value for '--encoder-strips' parameter: " << strips;
+                return false;
+            }
+            settings.strips = strips;
+        }
+
+        auto name = options->count("codec") ? (*options)["codec"].as<std::string>() : "libjpeg";
+        codec = create_jpeg_codec(name, settings);
+        if (not codec) {
+            return false;
+        }
+        if (pixel_format == V4L2_PIX_FMT_MJPEG) {
+            codec->reserve(frame_width, frame_height);
+        }
+
+        if ((*options)["motion"].as<bool>()) {
+            if (pixel_format != V4L2_PIX_FMT_MJPEG) {
+                LOG(ERROR) << "'--motion' requires MJPEG format";
+                return false;
+            }
+
+            MotionDetectorSettings settings;
+            if (options->count("motion-threshold")) {
+                settings.threshold = (*options)["motion-threshold"].as<int>();
+            }
+            if (options->count("motion-area")) {
+                settings.area_percent = (*options)["motion-area"].as<double>();
+            }
+            if (settings.threshold < 0 or settings.threshold > 255 or settings.area_percent < 0 or settings.area_percent > 100) {
+                LOG(ERROR) << "'--motion-threshold' has to be between 0 and 255, '--motion-area' between 0 and 100";
+                return false;
+            }
+
+            motion_pre_frames = options->count("motion-pre-frames") ? (*options)["motion-pre-frames"].as<int>() : 0;
+            motion_post_frames = options->count("motion-post-frames") ? (*options)["motion-post-frames"].as<int>() : 0;
+            if (motion_pre_frames < 0 or motion_pre_frames > kMaxMotionPreFrames) {
+                LOG(ERROR) << "invalid value for '--motion-pre-frames' parameter: " << motion_pre_frames;
+                return false;
+            }
+            if (motion_post_frames < 0) {
+                LOG(ERROR) << "invalid value for '--motion-post-frames' parameter: " << motion_post_frames;
+                return false;
+            }
+
+            motion_detector = MotionDetectorPtr(new MotionDetector(settings));
+        }
+
+        if ((*options)["skip-duplicates"].as<bool>()) {
+            if (pixel_format != V4L2_PIX_FMT_MJPEG) {
+                LOG(ERROR) << "'--skip-duplicates' requires MJPEG format";
+                return false;
+            }
+
+            auto distance = options->count("duplicate-distance") ? (*options)["duplicate-distance"].as<int>() : kDefaultDuplicateDistance;
+            if (distance < -1 or distance > 64) {
+                LOG(ERROR) << "invalid value for '--duplicate-distance' parameter: " << distance;
+                return false;
+            }
+
+            if (options->count("duplicate-max-run")) {
+                max_duplicates_in_row = (*options)["duplicate-max-run"].as<int>();
+                if (max_duplicates_in_row < 0) {
+                    LOG(ERROR) << "invalid value for '--duplicate-max-run' parameter: " << max_duplicates_in_row;
+                    return false;
+                }
+            }
+
+            duplicate_filter = DuplicateFilterPtr(new DuplicateFilter(distance));
+        }
+
+        if (options->count("burst")) {
+            burst_size = (*options)["burst"].as<int>();
+            if (burst_size <= 0) {
+                LOG(ERROR) << "invalid value for '--burst' parameter: " << burst_size;
+                return false;
+            }
+            if (burst_size > 1 and pixel_format != V4L2_PIX_FMT_MJPEG) {
+                LOG(ERROR) << "'--burst' requires MJPEG format";
+                return false;
+            }
+        }
+
+        if (options->count("stack")) {
+            stack_size = (*options)["stack"].as<int>();
+            if (stack_size <= 0 or stack_size > static_cast<int>(kMaxStackedFrames)) {
+                LOG(ERROR) << "invalid value for '--stack' parameter: " << stack_size;
+                return false;
+            }
+            if (stack_size > 1 and (pixel_format != V4L2_PIX_FMT_MJPEG or (*options)["save-jpeg-asis"].as<bool>() or burst_size > 1)) {
+                LOG(ERROR) << "'--stack' requires MJPEG format and can't be combined with '--save-jpeg-asis' or '--burst'";
+                return false;
+            }
+            if (stack_size > 1) {
+                frame_stacker = FrameStackerPtr(new FrameStacker(stack_size));
+                decoded_image.reserve(static_cast<size_t>(frame_width) * frame_height * 3);
+            }
+        }
+
+        return true;
+    }
+
+    bool
+    init_outputs()
+    {
+        if (config.result == kStdoutResult) {
+            StreamFormat format = StreamFormat::Raw;
+            if (options->count("stream-format")) {
+                auto name = (*options)["stream-format"].as<std::string>();
+                if (not StreamWriter::parse_format(name, format)) {
+                    LOG(ERROR) << "invalid value for '--stream-format' parameter: " << name;
+                    return false;
+                }
+            }
+
+            // keep at least half of the buffers queued in the driver while the reader lags behind,
+            // fewer if frames before motion and the best frame of a burst are held as well
+            int held_elsewhere = motion_pre_frames + (burst_size > 1 ? 1 : 0);
+            int max_spliced = std::min(kBuffersCount / 2, kBuffersCount - kMinQueuedBuffers - held_elsewhere);
+            // a reader which splices or tees pages out of the pipe keeps referencing them after they are read
+            if ((*options)["stream-copy"].as<bool>()) {
+                max_spliced = 0;
+            }
+
+            stream_writer = StreamWriterPtr(new StreamWriter);
+            if (not stream_writer->open_stdout(format, max_spliced)) {
+                return false;
+            }
+        } else if (not config.result.empty()) {
+            auto use_strftime = (*options)["strftime"].as<bool>();
+
+            if (not file_name_template.parse(config.result, use_strftime, config.device)) {
+                LOG(ERROR) << "invalid '--result' template: " << file_name_template.error();
+                return false;
+            }
+
+            ShardMode shard_mode = ShardMode::None;
+            if (options->count("shard")) {
+                auto name = (*options)["shard"].as<std::string>();
+                if (not FrameStorage::parse_shard_mode(name, shard_mode)) {
+                    LOG(ERROR) << "invalid value for '--shard' parameter: " << name;
+                    return false;
+                }
+            }
+
+            int shard_size = options->count("shard-size") ? (*options)["shard-size"].as<int>() : kDefaultShardSize;
+            if (shard_size <= 0) {
+                LOG(ERROR) << "invalid value for '--shard-size' parameter: " << shard_size;
+                return false;
+            }
+
+            if (not storage.configure(shard_mode, shard_size)) {
+                return false;
+            }
+
+            DurabilityMode durability = DurabilityMode::None;
+            if (options->count("durability")) {
+                auto name = (*options)["durability"].as<std::string>();
+                if (not FrameStorage::parse_durability_mode(name, durability)) {
+                    LOG(ERROR) << "invalid value for '--durability' parameter: " << name;
+                    return false;
+                }
+            }
+
+            int sync_frames = options->count("sync-frames") ? (*options)["sync-frames"].as<int>() : kDefaultSyncFrames;
+            int sync_interval = options->count("sync-interval") ? (*options)["sync-interval"].as<int>() : kDefaultSyncIntervalMs;
+            if (sync_frames <= 0 or sync_interval <= 0) {
+                LOG(ERROR) << "'--sync-frames' and '--sync-interval' have to be positive";
+                return false;
+            }
+
+            if (not storage.configure_durability(durability, sync_frames, sync_interval)) {
+                return false;
+            }
+
+            if ((*options)["governor"].as<bool>()) {
+                StorageGovernorSettings settings;
+                if (options->count("governor-free-space")) {
+                    settings.min_free_percent = (*options)["governor-free-space"].as<double>();
+                }
+                if (options->count("governor-latency")) {
+                    settings.max_write_latency_ms = (*options)["governor-latency"].as<double>();
+                }
+                if (options->count("governor-min-quality")) {
+                    settings.min_quality = (*options)["governor-min-quality"].as<int>();
+                }
+
+                if (settings.min_free_percent < 0 or settings.min_free_percent > 100 or settings.max_write_latency_ms <= 0
+                    or settings.min_quality < 0 or settings.min_quality > 100) {
+                    LOG(ERROR) << "invalid storage governor settings";
+                    return false;
+                }
+
+                governor = StorageGovernorPtr(new StorageGovernor(settings, metrics));
+            }
+        }
+
+        if (options->count("rtp")) {
+            size_t packet_size = kDefaultRTPPacketSize;
+            if (options->count("rtp-packet-size")) {
+                auto size = (*options)["rtp-packet-size"].as<int>();
+                if (size <= 0) {
+                    LOG(ERROR) << "invalid value for '--rtp-packet-size' parameter: " << size;
+                    return false;
+                }
+                packet_size = size;
+            }
+
+            // every frame would be skipped
+            if (frame_width > kRTPJPEGMaxDimension or frame_height > kRTPJPEGMaxDimension) {
+                LOG(ERROR) << "RTP/JPEG can't carry " << frame_width << "x" << frame_height << " images, '--rtp' requires both dimensions "
+                           << "up to " << kRTPJPEGMaxDimension;
+                return false;
+            }
+
+            rtp_sender = RTPJPEGSenderPtr(new RTPJPEGSender);
+            if (not rtp_sender->open((*options)["rtp"].as<std::string>(), packet_size)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    std::tuple<bool, uint32_t, uint32_t>
+    parse_resolution()
+    {
+        uint32_t x = 0, y = 0;
+        bool ok = true;
+
+        auto resolution = config.resolution;
+        auto delimeter = resolution.find("x");
+
+        if ((delimeter != std::string::npos) and (delimeter + 1 < resolution.size())) {
+            auto x_str = resolution.substr(0, delimeter);
+            auto y_str = resolution.substr(delimeter + 1, resolution.size() - 1);
+
+            try {
+                x = std::stoul(x_str);
+                y = std::stoul(y_str);
+            } catch (std::invalid_argument& exc) {
+                LOG(ERROR) << "no conversion could be performed: " << exc.what();
+                ok = false;
+            } catch (std::out_of_range& exc) {
+                LOG(ERROR) << "out of range error: " << exc.what();
+                ok = false;
+            }
+        } else {
+            LOG(ERROR) << "invalid resolution description: " << resolution;
+            ok = false;
+        }
+
+        return std::make_tuple(ok, x, y);
+    }
+
+    bool
+    make_jpeg_file_name(const struct v4l2_buffer& bufferinfo, uint64_t counter, const struct timespec& now)
+    {
+        if (not file_name_template.render(counter, bufferinfo.sequence, now, jpeg_file_name)) {
+            LOG(ERROR) << "couldn't create result file name: " << file_name_template.error();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Re-encodes the frame into jpeg_buffer.
+    bool
+    encode_frame(const unsigned char* data, size_t size, int quality, unsigned scale_denom)
+    {
+        if (pixel_format == V4L2_PIX_FMT_MJPEG) {
+            return codec->recompress(data, size, quality, scale_denom, raw_ycbcr, jpeg_buffer);
+        }
+
+        // Uncompressed frames are already YCbCr, they go to the encoder as is.
+        bool ok;
+        if (pixel_format == V4L2_PIX_FMT_YUYV) {
+            ok = yuyv_to_ycbcr(data, size, frame_width, frame_height, frame_bytes_per_line, ycbcr_image);
+        } else {
+            ok = nv12_to_ycbcr(data, size, frame_width, frame_height, frame_bytes_per_line, ycbcr_image);
+        }
+        if (not ok) {
+            LOG(ERROR) << "incomplete frame: " << size << " bytes";
+            return false;
+        }
+
+        ycbcr_image.decimate(scale_denom);
+        ycbcr_image.pad_edges();
+
+        return codec->compress(ycbcr_image, quality, jpeg_buffer);
+    }
+
+    // Frames are analyzed for several features, the last result is reused.
+    bool
+    analyze_dct(const struct v4l2_buffer& bufferinfo)
+    {
+        if (dct_analyzed and bufferinfo.sequence == dct_analyzed_sequence) {
+            return true;
+        }
+
+        auto data = static_cast<const unsigned char*>(buffers[bufferinfo.index].start);
+        size_t size = bufferinfo.bytesused > 0 ? bufferinfo.bytesused : bufferinfo.length;
+
+        dct_analyzed = dct_analyzer.analyze(data, size);
+        dct_analyzed_sequence = bufferinfo.sequence;
+
+        return dct_analyzed;
+    }
+
+    bool
+    duplicate_frame(const struct v4l2_buffer& bufferinfo)
+    {
+        auto data = static_cast<const unsigned char*>(buffers[bufferinfo.index].start);
+        size_t size = bufferinfo.bytesused > 0 ? bufferinfo.bytesused : bufferinfo.length;
+
+        JPEGInfo info;
+        if (not parse_jpeg_header(data, size, info)) {
+            return false;
+        }
+
+        auto result = duplicate_filter->check_exact(data + info.scan_offset, info.scan_size);
+        if (result == DuplicateFilter::Exact) {
+            if (++exact_duplicates_in_row == kFrozenCameraFrames) {
+                LOG(WARNING) << config.device << " has repeated the same frame " << kFrozenCameraFrames << " times, the camera may be frozen";
+            }
+        } else {
+            exact_duplicates_in_row = 0;
+
+            if (analyze_dct(bufferinfo)) {
+                result = duplicate_filter->check_similar(dct_analyzer.dc_image(), dct_analyzer.dc_width(), dct_analyzer.dc_height());
+            }
+        }
+
+        if (result == DuplicateFilter::Unique) {
+            duplicates_in_row = 0;
+            return false;
+        }
+
+        // a static scene still gets a frame stored now and then, so '--count' is reached
+        if (max_duplicates_in_row > 0 and duplicates_in_row >= max_duplicates_in_row) {
+            metrics.increment("frames_duplicate_kept");
+            duplicates_in_row = 0;
+            return false;
+        }
+
+        metrics.increment(result == DuplicateFilter::Exact ? "frames_duplicate_exact" : "frames_duplicate_similar");
+        duplicates_in_row++;
+
+        return true;
+    }
+
+    bool
+    write_frame(const struct v4l2_buffer& bufferinfo, const struct timespec& timestamp, bool& buffer_held)
+    {
+        if (not write_jpeg(bufferinfo, frames_taken, timestamp, buffer_held)) {
+            metrics.increment("frames_failed");
+            return false;
+        }
+
+        metrics.increment("frames_written");
+        frames_taken++;
+
+        return true;
+    }
+
+    // Compares the frame's DC image to the background, frames within
+    // '--motion-post-frames' after the last motion count as motion too.
+    bool
+    motion_detected(const struct v4l2_buffer& bufferinfo)
+    {
+        // frames which can't be analyzed are kept
+        if (not analyze_dct(bufferinfo) or motion_detector->detect(dct_analyzer.dc_image())) {
+            if (motion_post_frames_left == 0) {
+                metrics.increment("motion_events");
+            }
+            motion_post_frames_left = motion_post_frames + 1;
+        }
+
+        if (motion_post_frames_left > 0) {
+            motion_post_frames_left--;
+            return true;
+        }
+
+        metrics.increment("frames_without_motion");
+
+        return false;
+    }
+
+    bool
+    hold_pre_motion_frame(const struct v4l2_buffer& bufferinfo, bool& buffer_held)
+    {
+        if (motion_pre_frames == 0) {
+            return true;
+        }
+
+        PendingFrame frame;
+        frame.bufferinfo = bufferinfo;
+        clock_gettime(CLOCK_REALTIME, &frame.timestamp);
+
+        pre_motion_frames.push_back(frame);
+        buffer_held = true;
+
+        if (pre_motion_frames.size() > static_cast<size_t>(motion_pre_frames)) {
+            auto index = pre_motion_frames.front().bufferinfo.index;
+            pre_motion_frames.pop_front();
+            return queue_buffer(index);
+        }
+
+        return true;
+    }
+
+    bool
+    write_pre_motion_frames()
+    {
+        while (not pre_motion_frames.empty()) {
+            auto frame = pre_motion_frames.front();
+            pre_motion_frames.pop_front();
+
+            bool buffer_held = false;
+            if (not write_frame(frame.bufferinfo, frame.timestamp, buffer_held) and not ignore_jpeg_errors) {
+                return false;
+            }
+
+            if (not buffer_held and not queue_buffer(frame.bufferinfo.index)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Decodes the frame into the stack, once the stack is complete its average
+    // is encoded and written, written tells if that has happened.
+    bool
+    add_stacked_frame(const struct v4l2_buffer& bufferinfo, const struct timespec& timestamp, bool& written)
+    {
+        written = false;
+
+        unsigned scale_denom = 1;
+        int quality = output_quality(scale_denom);
+        size_t size = bufferinfo.bytesused > 0 ? bufferinfo.bytesused : bufferinfo.length;
+
+        auto data = static_cast<const unsigned char*>(buffers[bufferinfo.index].start);
+        if (not codec->decompress(data, size, scale_denom, decoded_image)) {
+            LOG(ERROR) << "image decompression failed!";
+            metrics.increment("frames_failed");
+            return ignore_jpeg_errors;
+        }
+
+        // the stack restarts if the governor changes the scale
+        auto samples = decoded_image.raw_data.get();
+        if (not frame_stacker->add(samples, static_cast<size_t>(decoded_image.width) * decoded_image.height * 3)) {
+            return true;
+        }
+
+        frame_stacker->average(samples);
+        metrics.increment("frames_stacked", stack_size);
+
+        bool buffer_held = false;
+        written = codec->compress(decoded_image, quality, jpeg_buffer)
+            and output_jpeg(bufferinfo, frames_taken, timestamp, jpeg_buffer.data(), jpeg_buffer.size(), nullptr, buffer_held);
+
+        if (not written) {
+            metrics.increment("frames_failed");
+            return ignore_jpeg_errors;
+        }
+
+        metrics.increment("frames_written");
+        frames_taken++;
+
+        return true;
+    }
+
+    // Keeps the sharpest frame of a burst in its capture buffer and writes it
+    // once the burst is complete, written tells if that has happened.
+    bool
+    add_burst_frame(const struct v4l2_buffer& bufferinfo, const struct timespec& timestamp, bool& written, bool& buffer_held)
+    {
+        written = false;
+
+        // frames which can't be analyzed are only taken if nothing else is there
+        double sharpness = analyze_dct(bufferinfo) ? dct_analyzer.sharpness() : -1;
+
+        if (burst_frames == 0 or sharpness > burst_sharpness) {
+            if (burst_frames > 0 and not queue_buffer(burst_best.bufferinfo.index)) {
+                return false;
+            }
+            burst_best.bufferinfo = bufferinfo;
+            burst_best.timestamp = timestamp;
+            burst_sharpness = sharpness;
+            buffer_held = true;
+        }
+
+        if (++burst_frames < burst_size) {
+            return true;
+        }
+
+        burst_frames = 0;
+        metrics.increment("frames_burst_discarded", burst_size - 1);
+
+        bool best_held = false;
+        written = write_frame(burst_best.bufferinfo, burst_best.timestamp, best_held);
+
+        if (not best_held and not queue_buffer(burst_best.bufferinfo.index)) {
+            return false;
+        }
+
+        return written or ignore_jpeg_errors;
+    }
+
+    // Tells if auto-exposure has converged: mean luma, taken from DC
+    // coefficients, has changed by no more than the tolerance for a few
+    // frames in a row.
+    bool
+    exposure_settled(const struct v4l2_buffer& bufferinfo)
+    {
+        if (not analyze_dct(bufferinfo)) {
+            warmup_stable_frames = 0;
+            return false;
+        }
+
+        auto luma = dct_analyzer.mean_luma();
+        auto tolerance = options->count("warmup-tolerance") ? (*options)["warmup-tolerance"].as<double>() : kDefaultWarmupTolerance;
+
+        if (frames_skipped > 0 and std::fabs(luma - warmup_luma) <= tolerance) {
+            warmup_stable_frames++;
+        } else {
+            warmup_stable_frames = 0;
+        }
+        warmup_luma = luma;
+
+        if (warmup_stable_frames < kWarmupStableFrames) {
+            return false;
+        }
+
+        metrics.set("warmup_frames", frames_skipped);
+        LOG(INFO) << config.device << ": exposure has settled after " << frames_skipped << " frames, mean luma " << std::lround(luma);
+
+        return true;
+    }
+
+    // Drops frames the camera has delivered damaged (e.g. after USB transfer
+    // errors) before they are written or streamed.
+    bool
+    frame_valid(const struct v4l2_buffer& bufferinfo)
+    {
+        auto defect = JPEGDefect::None;
+
+        if (bufferinfo.flags & V4L2_BUF_FLAG_ERROR) {
+            defect = JPEGDefect::Header;
+        } else {
+            auto data = static_cast<const unsigned char*>(buffers[bufferinfo.index].start);
+            size_t size = bufferinfo.bytesused > 0 ? bufferinfo.bytesused : bufferinfo.length;
+            JPEGInfo info;
+
+            defect = validate_jpeg(data, size, frame_width, frame_height, info);
+        }
+
+        if (defect == JPEGDefect::None) {
+            return true;
+        }
+
+        metrics.increment("frames_corrupt");
+        metrics.increment(std::string("frames_corrupt_") + jpeg_defect_name(defect));
+
+        auto quiet = (*options)["quiet"].as<bool>();
+        if (not quiet) {
+            LOG(WARNING) << "dropping corrupt frame #" << bufferinfo.sequence << " from " << config.device << ": bad "
+                         << jpeg_defect_name(defect);
+        }
+
+        return false;
+    }
+
+    // Estimating quality takes a hundred table comparisons, cameras rarely
+    // change their tables, so the last estimate is reused while they are the same.
+    int
+    source_quality(const JPEGInfo& info)
+    {
+        auto hash = hash_quant_tables(info);
+        if (hash != source_quant_hash or source_quality_estimate == 0) {
+            source_quant_hash = hash;
+            source_quality_estimate = estimate_jpeg_quality(info);
+            if (source_quality_estimate == 0) {
+                // no tables to go by, always re-encode
+                source_quality_estimate = kMaxJPEGQuality + 1;
+            }
+        }
+
+        return source_quality_estimate;
+    }
+
+    bool
+    write_jpeg(const struct v4l2_buffer& bufferinfo, uint64_t counter, const struct timespec& now, bool& buffer_held)
+    {
+        auto idx = bufferinfo.index;
+
+        buffer_held = false;
+
+        auto jpeg_data = static_cast<const unsigned char*>(buffers[idx].start);
+        size_t jpeg_size = bufferinfo.bytesused > 0 ? bufferinfo.bytesused : bufferinfo.length;
+
+        unsigned scale_denom = 1;
+        int quality = output_quality(scale_denom);
+
+        JPEGInfo info;
+        bool info_parsed = false;
+
+        auto save_jpeg_asis = (*options)["save-jpeg-asis"].as<bool>();
+        if (not save_jpeg_asis and camera_quality > 0 and quality >= camera_quality and scale_denom == 1) {
+            save_jpeg_asis = true;
+        }
+
+        if (not save_jpeg_asis and skip_reencode and scale_denom == 1) {
+            info_parsed = parse_jpeg_header(jpeg_data, jpeg_size, info);
+            if (info_parsed and source_quality(info) <= quality + kReencodeQualityMargin) {
+                metrics.increment("frames_reencode_skipped");
+                save_jpeg_asis = true;
+            }
+        }
+
+        if (not save_jpeg_asis) { // (Re)compress JPEG
+            try {
+                if (not encode_frame(jpeg_data, jpeg_size, quality, scale_denom)) {
+                    return false;
+                }
+            } catch (std::exception& exc) {
+                LOG(WARNING) << "image (de)compression failed: " << exc.what();
+                return false;
+            }
+
+            jpeg_data = jpeg_buffer.data();
+            jpeg_size = jpeg_buffer.size();
+        } else if (not info_parsed) {
+            info_parsed = parse_jpeg_header(jpeg_data, jpeg_size, info);
+        }
+
+        // camera's frames usually lack Huffman tables, outputs add them as needed
+        const JPEGInfo* missing_dht = save_jpeg_asis and info_parsed and not info.has_dht ? &info : nullptr;
+
+        return output_jpeg(bufferinfo, counter, now, jpeg_data, jpeg_size, missing_dht, buffer_held);
+    }
+
+    // Quality and scale of re-encoded images, the governor may lower both.
+    int
+    output_quality(unsigned& scale_denom)
+    {
         int quality = kDefaultJPEGQuality;
         if (options->count("quality")) {
             quality = (*options)["quality"].as<int>();
         }
 
-        jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
-        jpeg_start_compress(&cinfo, TRUE);
+        scale_denom = 1;
+        if (governor) {
+            quality = governor->quality(quality);
+            scale_denom = governor->scale_denom();
+        }
+
+        return quality;
+    }
+
+    // Sends the image to all outputs. Data in the capture buffer may be spliced
+    // to the stdout pipe, then the buffer is held until the pipe releases it.
+    // If missing_dht is set the image has no Huffman tables: RTP doesn't carry
+    // them anyway, the stream and files get the standard ones inserted.
+    bool
+    output_jpeg(const struct v4l2_buffer& bufferinfo, uint64_t counter, const struct timespec& now, const unsigned char* jpeg_data,
+        size_t jpeg_size, const JPEGInfo* missing_dht, bool& buffer_held)
+    {
+        auto idx = bufferinfo.index;
+
+        buffer_held = false;
+
+        if (rtp_sender) {
+            bool supported;
+            if (not rtp_sender->send(jpeg_data, jpeg_size, bufferinfo.timestamp, supported)) {
+                return false;
+            }
+            if (not supported) {
+                metrics.increment("frames_rtp_skipped");
+            }
+        }
+
+        if (stream_writer) {
+            if (jpeg_data == buffers[idx].start) {
+                if (missing_dht) {
+                    // only the headers are copied, entropy-coded data is still spliced
+                    standard_huffman_tables_head(jpeg_data, *missing_dht, jpeg_buffer);
+                    return stream_writer->splice_frame(jpeg_buffer.data(), jpeg_buffer.size(), jpeg_data + missing_dht->sos_offset,
+                        standard_huffman_tables_tail_size(*missing_dht), idx, buffer_held);
+                }
+
+                return stream_writer->splice_frame(jpeg_data, jpeg_size, idx, buffer_held);
+            }
+
+            if (missing_dht) {
+                insert_standard_huffman_tables(jpeg_data, *missing_dht, jpeg_buffer);
+                return stream_writer->write_frame(jpeg_buffer.data(), jpeg_buffer.size());
+            }
+
+            return stream_writer->write_frame(jpeg_data, jpeg_size);
+        }
+
+        if (missing_dht) {
+            insert_standard_huffman_tables(jpeg_data, *missing_dht, jpeg_buffer);
+            jpeg_data = jpeg_buffer.data();
+            jpeg_size = jpeg_buffer.size();
+        }
+
+        if (not config.result.empty()) {
+            if (not make_jpeg_file_name(bufferinfo, counter, now)) {
+                return false;
+            }
+
+            auto started = std::chrono::steady_clock::now();
+            if (not storage.write(jpeg_file_name, counter, now, jpeg_data, jpeg_size)) {
+                return false;
+            }
+
+            if (governor) {
+                std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - started;
+                governor->record_write(latency.count());
+                governor->update(storage);
+            }
+
+            return true;
+        }
+
+        return true;
+    }
+
+};
+
+using V4L2DevicePtr = std::unique_ptr<V4L2Device>;
+
+// Services all devices from a single epoll set. Frames are handled by a pool of
+// workers shared by all devices, at most one job per device is in flight.
+class CaptureLoop
+{
+public:
+    CaptureLoop(const CaptureLoop&) = delete;
+
+    CaptureLoop(std::vector<V4L2DevicePtr>& capture_devices, unsigned workers_count, Metrics& metrics_registry)
+        : metrics(metrics_registry)
+        , pool(workers_count)
+    {
+        for (auto& device : capture_devices) {
+            DeviceState state;
+            state.device = device.get();
+            states.push_back(state);
+        }
+    }
+
+    ~CaptureLoop()
+    {
+        if (efd != -1) {
+            close(efd);
+        }
+        if (completion_fd != -1) {
+            close(completion_fd);
+        }
+    }
+
+    bool
+    run(int metrics_interval)
+    {
+        efd = epoll_create1(EPOLL_CLOEXEC);
+        if (efd == -1) {
+            LOG(ERROR) << "epoll_create() failed: " << strerror(errno);
+            return false;
+        }
+
+        completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (completion_fd == -1) {
+            LOG(ERROR) << "eventfd() failed: " << strerror(errno);
+            return false;
+        }
+
+        if (not add_to_epoll(completion_fd, kCompletionEvent)) {
+            return false;
+        }
+
+        for (size_t i = 0; i < states.size(); i++) {
+            if (not states[i].device->start() or not add_to_epoll(states[i].device->descriptor(), i)) {
+                return false;
+            }
+        }
+
+        struct epoll_event events[kMaxEpollEvents];
+        int timeout = metrics_interval > 0 ? metrics_interval * 1000 : -1;
+        auto last_metrics_report = std::chrono::steady_clock::now();
+        bool status = true;
+
+        while (status and not all_done()) {
+            auto rc = epoll_wait(efd, events, kMaxEpollEvents, timeout);
+            if (rc == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG(ERROR) << "epoll_wait() error: " << strerror(errno);
+                status = false;
+                break;
+            }
+
+            for (int i = 0; i < rc and status; i++) {
+                if (events[i].data.u64 == kCompletionEvent) {
+                    status = handle_completions();
+                    continue;
+                }
+
+                auto& state = states[events[i].data.u64];
+                if ((events[i].events & EPOLLERR) or (events[i].events & EPOLLHUP) or (!(events[i].events & EPOLLIN))) {
+                    LOG(ERROR) << "epoll error on " << state.device->name();
+                    status = false;
+                    break;
+                }
+
+                state.pending = true;
+                dispatch(state);
+            }
+
+            if (metrics_interval > 0) {
+                auto now = std::chrono::steady_clock::now();
+                if (now - last_metrics_report >= std::chrono::seconds(metrics_interval)) {
+                    metrics.report();
+                    last_metrics_report = now;
+                }
+            }
+        }
+
+        // let jobs in flight finish before the devices are stopped
+        while (any_busy()) {
+            auto rc = epoll_wait(efd, events, kMaxEpollEvents, -1);
+            if (rc == -1 and errno != EINTR) {
+                LOG(ERROR) << "epoll_wait() error: " << strerror(errno);
+                return false;
+            }
+            handle_completions();
+        }
+
+        for (auto& state : states) {
+            if (not state.device->stop()) {
+                status = false;
+            }
+        }
+
+        return status;
+    }
+
+private:
+    struct DeviceState {
+        V4L2Device* device = nullptr;
+        /* a job for the device is queued or running */
+        bool busy = false;
+        /* the device has become readable since the last job was dispatched */
+        bool pending = false;
+    };
+
+    static const uint64_t kCompletionEvent = UINT64_MAX;
+
+    Metrics& metrics;
+    std::vector<DeviceState> states;
+    WorkerPool pool;
+
+    int efd = -1;
+    int completion_fd = -1;
+
+    std::mutex completed_mutex;
+    std::vector<std::pair<size_t, bool>> completed;
+    std::vector<std::pair<size_t, bool>> completed_batch;
+
+    bool
+    add_to_epoll(int fd, uint64_t data)
+    {
+        struct epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+
+        event.data.u64 = data;
+        event.events = EPOLLIN | EPOLLET;
+
+        if (epoll_ctl(efd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            LOG(ERROR) << "epoll_ctl() failed: " << strerror(errno);
+            return false;
+        }
+
+        return true;
+    }
+
+    void
+    dispatch(DeviceState& state)
+    {
+        if (state.busy or not state.pending or state.device->finished()) {
+            return;
+        }
+
+        state.busy = true;
+        state.pending = false;
+
+        auto index = &state - states.data();
+        auto device = state.device;
+
+        pool.submit([this, index, device]() {
+            auto ok = device->process_frames();
+            {
+                std::lock_guard<std::mutex> lock(completed_mutex);
+                completed.push_back(std::make_pair(index, ok));
+            }
+            uint64_t one = 1;
+            if (write(completion_fd, &one, sizeof(one)) < 0) {
+                LOG(ERROR) << "eventfd write failed: " << strerror(errno);
+            }
+        });
+    }
+
+    bool
+    handle_completions()
+    {
+        uint64_t value;
+        if (read(completion_fd, &value, sizeof(value)) < 0 and errno != EAGAIN) {
+            LOG(ERROR) << "eventfd read failed: " << strerror(errno);
+            return false;
+        }
+
+        completed_batch.clear();
+        {
+            std::lock_guard<std::mutex> lock(completed_mutex);
+            completed_batch.swap(completed);
+        }
 
-        auto row_stride = image->width * 3; /* JSAMPLEs per row in image_buffer */
-        while (cinfo.next_scanline < cinfo.image_height) {
-            row_pointer[0] = &(image->raw_data.get()[cinfo.next_scanline * row_stride]);
-            jpeg_write_scanlines(&cinfo, row_pointer, 1);
+        bool status = true;
+        for (const auto& result : completed_batch) {
+            auto& state = states[result.first];
+            state.busy = false;
+            if (not result.second) {
+                status = false;
+                continue;
+            }
+            // frames may have arrived while the job was running
+            dispatch(state);
         }
 
-        jpeg_finish_compress(&cinfo);
-        fclose(outfile);
-        jpeg_destroy_compress(&cinfo);
+        return status;
+    }
+
+    bool
+    all_done() const
+    {
+        for (const auto& state : states) {
+            if (state.busy or not state.device->finished()) {
+                return false;
+            }
+        }
 
         return true;
     }
+
+    bool
+    any_busy() const
+    {
+        for (const auto& state : states) {
+            if (state.busy) {
+                return true;
+            }
+        }
+
+        return false;
+    }
 };
 
 int
@@ -609,18 +1854,58 @@ main(int argc, char** argv)
     // clang-format off
     options->add_options()
         ("h,help", "show this help and exit")
-        ("result", "jpeg image name template", cxxopts::value<std::string>())
-        ("device", "camera's device device use", cxxopts::value<std::string>()->default_value("/dev/video0"))
-        ("resolution", "image's resolution", cxxopts::value<std::string>()->default_value("640x480"))
+        ("result", "jpeg image name template (%d, %{counter}, %{sequence}, %{msec}, %{usec}, %{device}), '-' streams images to stdout; can be given for every --device", cxxopts::value<std::vector<std::string>>())
+        ("device", "camera's device device use, can be repeated to capture from several cameras", cxxopts::value<std::vector<std::string>>()->default_value("/dev/video0"))
+        ("resolution", "image's resolution, can be given for every --device", cxxopts::value<std::vector<std::string>>()->default_value("640x480"))
+        ("format", "pixel format to capture: mjpeg, yuyv or nv12 (default: mjpeg)", cxxopts::value<std::string>())
+        ("nearest-resolution", "use the supported resolution closest to the requested one", cxxopts::value<bool>())
         ("quality", "compression quality for jpeg file (default: 75)", cxxopts::value<int>())
         ("skip", "skip specified number of frames before first capture", cxxopts::value<int>())
+        ("warmup", "skip frames until camera's exposure settles, '--skip' limits the number of frames (default: 100)", cxxopts::value<bool>())
+        ("warmup-tolerance", "change of mean brightness between frames, 0-255, considered settled by '--warmup' (default: 2)", cxxopts::value<double>())
         ("count", "number of images to capture", cxxopts::value<int>())
+        ("fps", "frame rate to request from the camera, the closest supported one is used", cxxopts::value<double>())
         ("pause", "pause between subsequent captures in seconds", cxxopts::value<double>())
         ("loop", "run in a loop mode, overrides --count", cxxopts::value<bool>())
         ("strftime", "expand the filename with date and time information", cxxopts::value<bool>())
+        ("codec", "jpeg codec backend: libjpeg or turbojpeg (default: libjpeg)", cxxopts::value<std::string>())
+        ("speed", "codec speed profile: fastest, balanced or best (default: balanced)", cxxopts::value<std::string>())
+        ("raw-ycbcr", "re-encode camera's jpeg as YCbCr without converting it to RGB and back", cxxopts::value<bool>())
+        ("control", "set camera's control before capturing, name=value as named by v4l2-ctl (e.g. exposure_auto_priority=0), can be repeated", cxxopts::value<std::vector<std::string>>())
+        ("controls-file", "file with camera's controls to set, a name=value per line, applied before '--control'", cxxopts::value<std::string>())
+        ("camera-quality", "ask the camera to compress images with '--quality' and store them as is if it can", cxxopts::value<bool>())
+        ("skip-reencode", "store camera's jpeg as is when its quality estimated from quantization tables isn't above '--quality'", cxxopts::value<bool>())
         ("save-jpeg-asis", "store jpeg as we have received it from an USB camera", cxxopts::value<bool>())
         ("ignore-jpeg-errors", "ignore libjpeg errors", cxxopts::value<bool>())
         ("quiet", "do not show errors and warnings from libjpeg", cxxopts::value<bool>())
+        ("validate", "check structure of camera's jpeg frames and drop corrupt ones", cxxopts::value<bool>())
+        ("shard", "spread result files over subdirectories: none, day, hour or counter (default: none)", cxxopts::value<std::string>())
+        ("shard-size", "number of files per directory for '--shard counter' (default: 10000)", cxxopts::value<int>())
+        ("durability", "when result files are synced to disk: none, frame or group (default: none)", cxxopts::value<std::string>())
+        ("sync-frames", "commit a group after this number of files (default: 100)", cxxopts::value<int>())
+        ("sync-interval", "commit a group after this number of milliseconds (default: 1000)", cxxopts::value<int>())
+        ("governor", "lower quality, resolution and frame rate while the output filesystem is short of space or slow", cxxopts::value<bool>())
+        ("governor-free-space", "free space threshold for '--governor' in percents (default: 10)", cxxopts::value<double>())
+        ("governor-latency", "average write latency threshold for '--governor' in milliseconds (default: 100)", cxxopts::value<double>())
+        ("governor-min-quality", "'--governor' never lowers quality below this value (default: 30)", cxxopts::value<int>())
+        ("metrics-interval", "log metrics every specified number of seconds, 0 - only at exit (default: not logged)", cxxopts::value<int>())
+        ("sync-tolerance", "write frames of all devices as sets captured within the specified number of milliseconds, unmatched frames are dropped", cxxopts::value<double>())
+        ("motion", "store only frames with motion and frames around them", cxxopts::value<bool>())
+        ("motion-threshold", "change of 8x8 block's brightness, 0-255, considered motion (default: 25)", cxxopts::value<int>())
+        ("motion-area", "percent of changed blocks which triggers '--motion' (default: 1)", cxxopts::value<double>())
+        ("motion-pre-frames", "number of frames before motion to store as well, up to 16 (default: 0)", cxxopts::value<int>())
+        ("motion-post-frames", "number of frames after motion to store as well (default: 0)", cxxopts::value<int>())
+        ("burst", "capture this number of frames for every image and store the sharpest one (default: 1)", cxxopts::value<int>())
+        ("stack", "average this number of consecutive frames into every image to reduce noise, up to 256 (default: 1)", cxxopts::value<int>())
+        ("skip-duplicates", "don't store frames repeating the previous one or nearly identical to the last stored one", cxxopts::value<bool>())
+        ("duplicate-distance", "number of differing bits of 64-bit image hashes of nearly identical frames, -1 - exact repeats only (default: 2)", cxxopts::value<int>())
+        ("duplicate-max-run", "store a frame anyway after this number of duplicates skipped in a row, 0 - never (default: 300)", cxxopts::value<int>())
+        ("encoder-strips", "split every frame into this number of strips encoded in parallel (default: 1)", cxxopts::value<int>())
+        ("encoder-threads", "number of threads handling frames of all devices (default: number of devices)", cxxopts::value<int>())
+        ("stream-format", "format of the stdout stream: raw or length-prefixed (default: raw)", cxxopts::value<std::string>())
+        ("stream-copy", "copy frames to the stdout pipe instead of splicing them, needed if the reader splices or tees the pipe", cxxopts::value<bool>())
+        ("rtp", "stream images as RTP/JPEG to the specified host:port", cxxopts::value<std::string>())
+        ("rtp-packet-size", "maximum size of RTP packet in bytes (default: 1400)", cxxopts::value<int>())
         ;
     // clang-format on
 
@@ -658,16 +1943,134 @@ main(int argc, char** argv)
         }
     }
 
-    if (options->count("result") == 0) {
-        LOG(ERROR) << "Mandatory parameter '--result' was not specified.";
+    if (options->count("warmup-tolerance")) {
+        auto tolerance = (*options)["warmup-tolerance"].as<double>();
+        if (tolerance < 0) {
+            LOG(ERROR) << "invalid value for '--warmup-tolerance' parameter: " << tolerance;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options->count("result") == 0 and options->count("rtp") == 0) {
+        LOG(ERROR) << "Mandatory parameter '--result' (or '--rtp') was not specified.";
+        return EXIT_FAILURE;
+    }
+
+    auto device_names = (*options)["device"].as<std::vector<std::string>>();
+    auto resolutions = (*options)["resolution"].as<std::vector<std::string>>();
+    std::vector<std::string> results;
+    if (options->count("result")) {
+        results = (*options)["result"].as<std::vector<std::string>>();
+    }
+
+    if (resolutions.size() != 1 and resolutions.size() != device_names.size()) {
+        LOG(ERROR) << "'--resolution' has to be given once or for every '--device'";
+        return EXIT_FAILURE;
+    }
+
+    if (results.size() > 1 and results.size() != device_names.size()) {
+        LOG(ERROR) << "'--result' has to be given once or for every '--device'";
         return EXIT_FAILURE;
     }
 
-    V4L2Device dev(options);
-    auto ok = dev.initialize();
+    if (device_names.size() > 1) {
+        if (options->count("rtp")) {
+            LOG(ERROR) << "'--rtp' can be used with a single device only";
+            return EXIT_FAILURE;
+        }
+
+        for (const auto& result : results) {
+            if (result == kStdoutResult) {
+                LOG(ERROR) << "only a single device can be streamed to stdout";
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (results.size() == 1 and results[0].find("%{device}") == std::string::npos) {
+            LOG(ERROR) << "'--result' shared by several devices has to contain %{device}";
+            return EXIT_FAILURE;
+        }
+    }
+
+    int workers_count = device_names.size();
+    if (options->count("encoder-threads")) {
+        workers_count = (*options)["encoder-threads"].as<int>();
+        if (workers_count <= 0) {
+            LOG(ERROR) << "invalid value for '--encoder-threads' parameter: " << workers_count;
+            return EXIT_FAILURE;
+        }
+    }
+
+    ControlSettings controls;
+    if (options->count("controls-file")) {
+        if (not load_control_settings((*options)["controls-file"].as<std::string>(), controls)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options->count("control")) {
+        for (const auto& text : (*options)["control"].as<std::vector<std::string>>()) {
+            ControlSetting setting;
+            if (not parse_control_setting(text, setting)) {
+                LOG(ERROR) << "invalid value for '--control' parameter: " << text;
+                return EXIT_FAILURE;
+            }
+            controls.push_back(setting);
+        }
+    }
+
+    Metrics metrics;
+    std::vector<V4L2DevicePtr> devices;
+
+    for (size_t i = 0; i < device_names.size(); i++) {
+        DeviceConfig config;
+        config.device = device_names[i];
+        config.resolution = resolutions.size() == 1 ? resolutions[0] : resolutions[i];
+        if (not results.empty()) {
+            config.result = results.size() == 1 ? results[0] : results[i];
+        }
+        config.controls = controls;
+
+        devices.push_back(V4L2DevicePtr(new V4L2Device(options, config, metrics)));
+        if (not devices.back()->initialize()) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::unique_ptr<FrameSynchronizer> synchronizer;
+    if (options->count("sync-tolerance")) {
+        auto tolerance = (*options)["sync-tolerance"].as<double>();
+        if (tolerance < 0 or devices.size() < 2) {
+            LOG(ERROR) << "'--sync-tolerance' requires a non-negative value and at least two devices";
+            return EXIT_FAILURE;
+        }
+
+        if ((*options)["motion"].as<bool>() or options->count("burst") or options->count("stack")) {
+            LOG(ERROR) << "'--motion', '--burst' and '--stack' can't be combined with '--sync-tolerance'";
+            return EXIT_FAILURE;
+        }
 
-    if (ok) {
-        ok = dev.capture();
+        std::vector<SynchronizedSource*> sources;
+        for (auto& device : devices) {
+            sources.push_back(device.get());
+        }
+
+        synchronizer = std::unique_ptr<FrameSynchronizer>(new FrameSynchronizer(sources, std::llround(tolerance * 1000), metrics));
+        for (size_t i = 0; i < devices.size(); i++) {
+            devices[i]->set_synchronizer(synchronizer.get(), i);
+        }
+    }
+
+    int metrics_interval = options->count("metrics-interval") ? (*options)["metrics-interval"].as<int>() : 0;
+
+    CaptureLoop capture_loop(devices, workers_count, metrics);
+    auto ok = capture_loop.run(metrics_interval);
+
+    if (synchronizer) {
+        synchronizer->report();
+    }
+    if (options->count("metrics-interval")) {
+        metrics.report();
     }
 
     return (ok ? EXIT_SUCCESS : EXIT_FAILURE);
@@ -0,0 +1,54 @@
+#include "worker_pool.hpp"
+
+WorkerPool::WorkerPool(unsigned threads_count)
+{
+    for (unsigned i = 0; i < threads_count; i++) {
+        workers.emplace_back(&WorkerPool::worker_loop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        stopping = true;
+    }
+
+    jobs_cv.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void
+WorkerPool::submit(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        jobs.push_back(std::move(job));
+    }
+
+    jobs_cv.notify_one();
+}
+
+void
+WorkerPool::worker_loop()
+{
+    std::unique_lock<std::mutex> lock(jobs_mutex);
+
+    while (true) {
+        jobs_cv.wait(lock, [this] { return stopping or not jobs.empty(); });
+
+        if (jobs.empty()) {
+            break;
+        }
+
+        auto job = std::move(jobs.front());
+        jobs.pop_front();
+
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef UVCCAPTURE2_WORKER_POOL_HPP
+#define UVCCAPTURE2_WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads executing submitted jobs in FIFO order.
+class WorkerPool
+{
+public:
+    using Job = std::function<void()>;
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool(unsigned threads_count);
+
+    // Waits for the queued jobs to complete.
+    ~WorkerPool();
+
+    void submit(Job job);
+
+    unsigned
+    size() const
+    {
+        return workers.size();
+    }
+
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_cv;
+    std::deque<Job> jobs;
+    bool stopping = false;
+
+    void worker_loop();
+};
+
+#endif
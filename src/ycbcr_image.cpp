@@ -0,0 +1,252 @@
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "ycbcr_image.hpp"
+
+static const unsigned kBlockSize = 8;
+
+static unsigned
+round_up(unsigned value, unsigned multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+static unsigned
+divide_up(unsigned value, unsigned divisor)
+{
+    return (value + divisor - 1) / divisor;
+}
+
+// Splits a row of YUYV pixels into Y, Cb and Cr rows.
+static void
+deinterleave_yuyv_row(const unsigned char* src, unsigned char* y, unsigned char* u, unsigned char* v, unsigned pairs)
+{
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+
+    for (; pairs >= 16; pairs -= 16) {
+        auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+        auto c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+        auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+
+        auto y0 = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+        auto y1 = _mm_packus_epi16(_mm_and_si128(c, mask), _mm_and_si128(d, mask));
+        auto uv0 = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        auto uv1 = _mm_packus_epi16(_mm_srli_epi16(c, 8), _mm_srli_epi16(d, 8));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y), y0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + 16), y1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u), _mm_packus_epi16(_mm_and_si128(uv0, mask), _mm_and_si128(uv1, mask)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v), _mm_packus_epi16(_mm_srli_epi16(uv0, 8), _mm_srli_epi16(uv1, 8)));
+
+        src += 64;
+        y += 32;
+        u += 16;
+        v += 16;
+    }
+#elif defined(__ARM_NEON)
+    for (; pairs >= 16; pairs -= 16) {
+        auto pixels = vld4q_u8(src);
+        uint8x16x2_t luma = { { pixels.val[0], pixels.val[2] } };
+
+        vst2q_u8(y, luma);
+        vst1q_u8(u, pixels.val[1]);
+        vst1q_u8(v, pixels.val[3]);
+
+        src += 64;
+        y += 32;
+        u += 16;
+        v += 16;
+    }
+#endif
+
+    for (; pairs > 0; pairs--) {
+        y[0] = src[0];
+        *u++ = src[1];
+        y[1] = src[2];
+        *v++ = src[3];
+        src += 4;
+        y += 2;
+    }
+}
+
+// Splits a row of the NV12 chroma plane into Cb and Cr rows.
+static void
+deinterleave_uv_row(const unsigned char* src, unsigned char* u, unsigned char* v, unsigned pairs)
+{
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+
+    for (; pairs >= 16; pairs -= 16) {
+        auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+
+        src += 32;
+        u += 16;
+        v += 16;
+    }
+#elif defined(__ARM_NEON)
+    for (; pairs >= 16; pairs -= 16) {
+        auto chroma = vld2q_u8(src);
+
+        vst1q_u8(u, chroma.val[0]);
+        vst1q_u8(v, chroma.val[1]);
+
+        src += 32;
+        u += 16;
+        v += 16;
+    }
+#endif
+
+    for (; pairs > 0; pairs--) {
+        *u++ = src[0];
+        *v++ = src[1];
+        src += 2;
+    }
+}
+
+void
+YCbCrImage::resize(unsigned image_width, unsigned image_height, unsigned h_factor, unsigned v_factor)
+{
+    width = image_width;
+    height = image_height;
+    h_sampling = h_factor;
+    v_sampling = v_factor;
+
+    auto padded_width = round_up(width, kBlockSize * h_sampling);
+    auto padded_height = round_up(height, kBlockSize * v_sampling);
+
+    for (int plane = 0; plane < kYCbCrPlanes; plane++) {
+        strides[plane] = plane == 0 ? padded_width : padded_width / h_sampling;
+        rows[plane] = plane == 0 ? padded_height : padded_height / v_sampling;
+
+        size_t size = static_cast<size_t>(strides[plane]) * rows[plane];
+        if (planes[plane].size() < size) {
+            planes[plane].resize(size);
+        }
+    }
+}
+
+unsigned
+YCbCrImage::plane_width(int plane) const
+{
+    return plane == 0 ? width : divide_up(width, h_sampling);
+}
+
+unsigned
+YCbCrImage::plane_height(int plane) const
+{
+    return plane == 0 ? height : divide_up(height, v_sampling);
+}
+
+void
+YCbCrImage::decimate(unsigned denom)
+{
+    if (denom <= 1 or width < denom or height < denom) {
+        return;
+    }
+
+    auto source_strides = strides;
+
+    // The new layout is never larger than the old one and every sample moves
+    // towards the beginning of its plane, so samples can be moved in place.
+    resize(width / denom, height / denom, h_sampling, v_sampling);
+
+    for (int plane = 0; plane < kYCbCrPlanes; plane++) {
+        auto data = planes[plane].data();
+        auto plane_w = plane_width(plane);
+        auto plane_h = plane_height(plane);
+
+        for (unsigned y = 0; y < plane_h; y++) {
+            auto src = data + static_cast<size_t>(y) * denom * source_strides[plane];
+            auto dst = data + static_cast<size_t>(y) * strides[plane];
+            for (unsigned x = 0; x < plane_w; x++) {
+                dst[x] = src[x * denom];
+            }
+        }
+    }
+}
+
+void
+YCbCrImage::pad_edges()
+{
+    for (int plane = 0; plane < kYCbCrPlanes; plane++) {
+        auto plane_w = plane_width(plane);
+        auto plane_h = plane_height(plane);
+
+        if (plane_w < strides[plane]) {
+            for (unsigned y = 0; y < plane_h; y++) {
+                auto line = row(plane, y);
+                std::memset(line + plane_w, line[plane_w - 1], strides[plane] - plane_w);
+            }
+        }
+
+        for (unsigned y = plane_h; y < rows[plane]; y++) {
+            std::memcpy(row(plane, y), row(plane, plane_h - 1), strides[plane]);
+        }
+    }
+}
+
+bool
+yuyv_to_ycbcr(const unsigned char* data, size_t size, unsigned width, unsigned height, unsigned bytes_per_line, YCbCrImage& image)
+{
+    if (width < 2 or height == 0 or width % 2 != 0) {
+        return false;
+    }
+
+    if (bytes_per_line == 0) {
+        bytes_per_line = width * 2;
+    }
+
+    if (bytes_per_line < width * 2 or size < static_cast<size_t>(bytes_per_line) * (height - 1) + width * 2) {
+        return false;
+    }
+
+    image.resize(width, height, 2, 1);
+
+    for (unsigned y = 0; y < height; y++) {
+        deinterleave_yuyv_row(data + static_cast<size_t>(y) * bytes_per_line, image.row(0, y), image.row(1, y), image.row(2, y), width / 2);
+    }
+
+    return true;
+}
+
+bool
+nv12_to_ycbcr(const unsigned char* data, size_t size, unsigned width, unsigned height, unsigned bytes_per_line, YCbCrImage& image)
+{
+    if (width < 2 or height < 2 or width % 2 != 0 or height % 2 != 0) {
+        return false;
+    }
+
+    if (bytes_per_line == 0) {
+        bytes_per_line = width;
+    }
+
+    // Luma plane is followed by the plane of interleaved Cb/Cr pairs at half the height.
+    size_t luma_size = static_cast<size_t>(bytes_per_line) * height;
+    if (bytes_per_line < width or size < luma_size + static_cast<size_t>(bytes_per_line) * (height / 2 - 1) + width) {
+        return false;
+    }
+
+    image.resize(width, height, 2, 2);
+
+    for (unsigned y = 0; y < height; y++) {
+        std::memcpy(image.row(0, y), data + static_cast<size_t>(y) * bytes_per_line, width);
+    }
+
+    auto chroma = data + luma_size;
+    for (unsigned y = 0; y < height / 2; y++) {
+        deinterleave_uv_row(chroma + static_cast<size_t>(y) * bytes_per_line, image.row(1, y), image.row(2, y), width / 2);
+    }
+
+    return true;
+}
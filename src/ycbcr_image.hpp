@@ -0,0 +1,59 @@
+#ifndef UVCCAPTURE2_YCBCR_IMAGE_HPP
+#define UVCCAPTURE2_YCBCR_IMAGE_HPP
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+static const int kYCbCrPlanes = 3;
+
+// Planar Y/Cb/Cr image laid out the way libjpeg's raw data interface expects
+// it: chroma planes are subsampled by h_sampling x v_sampling, every plane is
+// padded to whole MCUs and the padding repeats the edge samples.
+class YCbCrImage
+{
+public:
+    // Sets geometry of the image, planes only ever grow so a steady stream of
+    // frames of the same size doesn't allocate.
+    void resize(unsigned image_width, unsigned image_height, unsigned h_factor, unsigned v_factor);
+
+    // Keeps every denom-th sample of every plane in both directions.
+    void decimate(unsigned denom);
+
+    // Fills the MCU padding with copies of the last column and row.
+    void pad_edges();
+
+    unsigned char*
+    row(int plane, unsigned y)
+    {
+        return planes[plane].data() + y * strides[plane];
+    }
+
+    const unsigned char*
+    row(int plane, unsigned y) const
+    {
+        return planes[plane].data() + y * strides[plane];
+    }
+
+    // Size of a plane without padding.
+    unsigned plane_width(int plane) const;
+    unsigned plane_height(int plane) const;
+
+    unsigned width = 0;
+    unsigned height = 0;
+    /* luma sampling factors relative to chroma: 2x1 for 4:2:2, 2x2 for 4:2:0 */
+    unsigned h_sampling = 1;
+    unsigned v_sampling = 1;
+
+    std::array<std::vector<unsigned char>, kYCbCrPlanes> planes;
+    /* padded width and height of every plane */
+    std::array<unsigned, kYCbCrPlanes> strides = { { 0, 0, 0 } };
+    std::array<unsigned, kYCbCrPlanes> rows = { { 0, 0, 0 } };
+};
+
+// Converters from V4L2 uncompressed formats, bytes_per_line is the stride of the
+// source buffer as reported by VIDIOC_S_FMT.
+bool yuyv_to_ycbcr(const unsigned char* data, size_t size, unsigned width, unsigned height, unsigned bytes_per_line, YCbCrImage& image);
+bool nv12_to_ycbcr(const unsigned char* data, size_t size, unsigned width, unsigned height, unsigned bytes_per_line, YCbCrImage& image);
+
+#endif
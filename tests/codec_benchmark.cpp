@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "easylogging++/easylogging++.h"
+
+#include "jpeg_codec.hpp"
+#include "test_jpeg.hpp"
+
+INITIALIZE_EASYLOGGINGPP
+
+static const unsigned kWidth = 1920;
+static const unsigned kHeight = 1080;
+static const int kCameraQuality = 90;
+static const int kQuality = 80;
+static const int kIterations = 20;
+
+static const char* kBackends[] = {
+    "libjpeg",
+#ifdef HAVE_TURBOJPEG
+    "turbojpeg",
+#endif
+};
+
+static const char* kProfiles[] = { "fastest", "balanced", "best" };
+
+struct Frame {
+    std::string name;
+    std::vector<unsigned char> jpeg;
+    /* the frame decoded by libjpeg with the accurate DCT, what outputs are compared to */
+    RGBImage reference;
+};
+
+template <typename F>
+static double
+best_time_ms(F function)
+{
+    double best = INFINITY;
+
+    for (int i = 0; i < kIterations; i++) {
+        auto started = std::chrono::steady_clock::now();
+        function();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - started;
+        best = std::min(best, elapsed.count());
+    }
+
+    return best;
+}
+
+static bool
+read_file(const std::string& path, std::vector<unsigned char>& data)
+{
+    std::ifstream file(path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    return file.good() or file.eof();
+}
+
+// Re-encodes the same frames with every backend built in, under every speed
+// profile, through RGB and kept in YCbCr. Reports the best time of several
+// runs, the output size and PSNR against the source frame. Without arguments
+// a synthetic 4:2:2 camera frame is used.
+//
+//   codec_benchmark [frame.jpg ...]
+int
+main(int argc, char* argv[])
+{
+    std::vector<Frame> frames;
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            Frame frame;
+            frame.name = argv[i];
+            if (not read_file(argv[i], frame.jpeg) or frame.jpeg.empty()) {
+                std::cerr << "couldn't read " << argv[i] << std::endl;
+                return 1;
+            }
+            frames.push_back(std::move(frame));
+        }
+    } else {
+        TestJPEGSettings settings;
+        settings.quality = kCameraQuality;
+        settings.v_sampling = 1;
+
+        Frame frame;
+        frame.name = "synthetic " + std::to_string(kWidth) + "x" + std::to_string(kHeight) + " 4:2:2";
+        frame.jpeg = make_test_jpeg(kWidth, kHeight, settings);
+        frames.push_back(std::move(frame));
+    }
+
+    auto reference_codec = create_jpeg_codec("libjpeg", CodecSettings());
+    for (auto& frame : frames) {
+        if (not reference_codec->decompress(frame.jpeg.data(), frame.jpeg.size(), 1, frame.reference)) {
+            std::cerr << "couldn't decode " << frame.name << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "quality " << kQuality << ", best of " << kIterations << " runs" << std::endl;
+
+    for (const auto& frame : frames) {
+        std::cout << std::endl << frame.name << ", " << frame.jpeg.size() << " bytes" << std::endl;
+
+        for (auto backend : kBackends) {
+            for (auto profile_name : kProfiles) {
+                CodecSettings settings;
+                parse_codec_profile(profile_name, settings.profile);
+
+                auto codec = create_jpeg_codec(backend, settings);
+                if (not codec) {
+                    return 1;
+                }
+
+                for (auto keep_ycbcr : { false, true }) {
+                    std::vector<unsigned char> output;
+                    bool ok = true;
+                    auto ms = best_time_ms(
+                        [&] { ok = ok and codec->recompress(frame.jpeg.data(), frame.jpeg.size(), kQuality, 1, keep_ycbcr, output); });
+
+                    RGBImage decoded;
+                    if (not ok or not reference_codec->decompress(output.data(), output.size(), 1, decoded)) {
+                        std::cerr << backend << " " << profile_name << " failed" << std::endl;
+                        return 1;
+                    }
+
+                    auto size = static_cast<size_t>(decoded.width) * decoded.height * 3;
+                    std::cout << std::left << std::setw(10) << backend << std::setw(9) << profile_name << std::setw(6)
+                              << (keep_ycbcr ? "YCbCr" : "RGB") << std::right << std::fixed << std::setprecision(2) << std::setw(8) << ms
+                              << " ms" << std::setw(9) << output.size() << " bytes" << std::setw(7)
+                              << psnr(frame.reference.raw_data.get(), decoded.raw_data.get(), size) << " dB" << std::endl;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
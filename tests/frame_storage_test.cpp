@@ -0,0 +1,211 @@
+#include <dirent.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "easylogging++/easylogging++.h"
+
+#include "frame_storage.hpp"
+#include "test_util.hpp"
+
+INITIALIZE_EASYLOGGINGPP
+
+static std::string
+read_file(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static std::vector<std::string>
+list_directory(const std::string& path)
+{
+    std::vector<std::string> names;
+
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return names;
+    }
+
+    while (auto entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name != "." and name != "..") {
+            names.push_back(name);
+        }
+    }
+
+    closedir(dir);
+
+    return names;
+}
+
+static void
+remove_directory(const std::string& path)
+{
+    for (const auto& name : list_directory(path)) {
+        auto entry = path + "/" + name;
+        struct stat st;
+        if (lstat(entry.c_str(), &st) == 0 and S_ISDIR(st.st_mode)) {
+            remove_directory(entry);
+        } else {
+            unlink(entry.c_str());
+        }
+    }
+    rmdir(path.c_str());
+}
+
+static std::vector<std::string>
+sorted(std::vector<std::string> names)
+{
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+static bool
+write_string(FrameStorage& storage, const std::string& file_name, uint64_t counter, const std::string& data)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return storage.write(file_name, counter, now, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+}
+
+// The same final name written several times within one group (e.g. --result
+// latest.jpg) must end up with the most recent data and must not break later commits.
+static void
+test_group_same_name(const std::string& root)
+{
+    auto directory = root + "/group";
+    EXPECT(mkdir(directory.c_str(), 0755) == 0);
+
+    {
+        FrameStorage storage;
+        EXPECT(storage.configure(ShardMode::None, kDefaultShardSize));
+        EXPECT(storage.configure_durability(DurabilityMode::Group, 100, 60000));
+
+        EXPECT(write_string(storage, directory + "/latest.jpg", 0, "first"));
+        EXPECT(write_string(storage, directory + "/latest.jpg", 1, "second"));
+        EXPECT(write_string(storage, directory + "/other.jpg", 2, "other"));
+        EXPECT(write_string(storage, directory + "/latest.jpg", 3, "third"));
+
+        EXPECT(storage.flush());
+    }
+
+    EXPECT(read_file(directory + "/latest.jpg") == "third");
+    EXPECT(read_file(directory + "/other.jpg") == "other");
+    EXPECT(list_directory(directory).size() == 2);
+
+    remove_directory(directory);
+}
+
+// Every group commit is a separate batch, files written after a commit still
+// replace the committed ones.
+static void
+test_group_consecutive_commits(const std::string& root)
+{
+    auto directory = root + "/groups";
+    EXPECT(mkdir(directory.c_str(), 0755) == 0);
+
+    {
+        FrameStorage storage;
+        EXPECT(storage.configure(ShardMode::None, kDefaultShardSize));
+        EXPECT(storage.configure_durability(DurabilityMode::Group, 2, 10));
+
+        for (int i = 0; i < 20; i++) {
+            EXPECT(write_string(storage, directory + "/latest.jpg", i, std::to_string(i)));
+            if (i % 5 == 0) {
+                usleep(20000);
+            }
+        }
+
+        EXPECT(storage.flush());
+    }
+
+    EXPECT(read_file(directory + "/latest.jpg") == "19");
+    EXPECT(list_directory(directory).size() == 1);
+
+    remove_directory(directory);
+}
+
+// Counter sharding starts a new bucket exactly at every multiple of the shard size.
+static void
+test_counter_shard_rollover(const std::string& root)
+{
+    auto directory = root + "/shards";
+    EXPECT(mkdir(directory.c_str(), 0755) == 0);
+
+    {
+        FrameStorage storage;
+        EXPECT(storage.configure(ShardMode::Counter, 3));
+
+        for (uint64_t counter = 0; counter < 8; counter++) {
+            EXPECT(write_string(storage, directory + "/" + std::to_string(counter) + ".jpg", counter, std::to_string(counter)));
+        }
+
+        EXPECT(storage.flush());
+    }
+
+    EXPECT((sorted(list_directory(directory)) == std::vector<std::string> { "000000", "000001", "000002" }));
+    EXPECT((sorted(list_directory(directory + "/000000")) == std::vector<std::string> { "0.jpg", "1.jpg", "2.jpg" }));
+    EXPECT((sorted(list_directory(directory + "/000001")) == std::vector<std::string> { "3.jpg", "4.jpg", "5.jpg" }));
+    EXPECT((sorted(list_directory(directory + "/000002")) == std::vector<std::string> { "6.jpg", "7.jpg" }));
+    EXPECT(read_file(directory + "/000001/3.jpg") == "3");
+
+    remove_directory(directory);
+}
+
+// Bucket numbers are zero-padded to six digits so they sort, longer ones are kept whole.
+static void
+test_counter_shard_names(const std::string& root)
+{
+    auto directory = root + "/buckets";
+    EXPECT(mkdir(directory.c_str(), 0755) == 0);
+
+    {
+        FrameStorage storage;
+        EXPECT(storage.configure(ShardMode::Counter, kDefaultShardSize));
+
+        EXPECT(write_string(storage, directory + "/a.jpg", kDefaultShardSize - 1, "a"));
+        EXPECT(write_string(storage, directory + "/b.jpg", kDefaultShardSize, "b"));
+        EXPECT(write_string(storage, directory + "/c.jpg", uint64_t(kDefaultShardSize) * 1234567, "c"));
+
+        EXPECT(storage.flush());
+    }
+
+    EXPECT(read_file(directory + "/000000/a.jpg") == "a");
+    EXPECT(read_file(directory + "/000001/b.jpg") == "b");
+    EXPECT(read_file(directory + "/1234567/c.jpg") == "c");
+
+    remove_directory(directory);
+}
+
+int
+main()
+{
+    char root_template[] = "/tmp/frame_storage_test.XXXXXX";
+    if (mkdtemp(root_template) == nullptr) {
+        std::cerr << "can't create temporary directory" << std::endl;
+        return 1;
+    }
+    std::string root = root_template;
+
+    test_group_same_name(root);
+    test_group_consecutive_commits(root);
+    test_counter_shard_rollover(root);
+    test_counter_shard_names(root);
+
+    rmdir(root.c_str());
+
+    return test_result();
+}
@@ -0,0 +1,167 @@
+#include <linux/videodev2.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "easylogging++/easylogging++.h"
+
+#include "frame_synchronizer.hpp"
+#include "metrics.hpp"
+#include "test_util.hpp"
+
+INITIALIZE_EASYLOGGINGPP
+
+static const std::chrono::milliseconds kTimeout(2000);
+
+// Records written sets, writes can be blocked to simulate slow encoding.
+class TestSource : public SynchronizedSource
+{
+public:
+    bool
+    write_synchronized(const struct v4l2_buffer&, uint64_t counter, const struct timespec&) override
+    {
+        writing++;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return not blocked; });
+        counters.push_back(counter);
+        lock.unlock();
+
+        writing--;
+
+        return true;
+    }
+
+    bool
+    release_buffer(uint32_t) override
+    {
+        released++;
+        return true;
+    }
+
+    void
+    block(bool value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocked = value;
+        cv.notify_all();
+    }
+
+    std::vector<uint64_t>
+    written()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+    std::atomic<int> writing { 0 };
+    std::atomic<int> released { 0 };
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool blocked = false;
+    std::vector<uint64_t> counters;
+};
+
+static struct v4l2_buffer
+make_buffer(uint32_t index, uint64_t timestamp_ms)
+{
+    struct v4l2_buffer bufferinfo;
+    std::memset(&bufferinfo, 0, sizeof(bufferinfo));
+    bufferinfo.index = index;
+    bufferinfo.timestamp.tv_sec = timestamp_ms / 1000;
+    bufferinfo.timestamp.tv_usec = (timestamp_ms % 1000) * 1000;
+
+    return bufferinfo;
+}
+
+template <typename F>
+static bool
+wait_for(F condition)
+{
+    auto deadline = std::chrono::steady_clock::now() + kTimeout;
+
+    while (not condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+// While one worker writes a set, other devices' frames are still accepted and
+// a later set isn't written to a source ahead of the earlier one.
+static void
+test_write_outside_lock()
+{
+    Metrics metrics;
+    TestSource first, second;
+    FrameSynchronizer synchronizer({ &first, &second }, 1000, metrics);
+
+    first.block(true);
+
+    // completes set 0, its writer stays in first.write_synchronized()
+    EXPECT(synchronizer.submit(0, make_buffer(0, 100)));
+    auto writer = std::async(std::launch::async, [&] { return synchronizer.submit(1, make_buffer(0, 100)); });
+    EXPECT(wait_for([&] { return first.writing == 1; }));
+
+    // the synchronizer itself isn't locked by the writer
+    auto queued = std::async(std::launch::async, [&] { return synchronizer.submit(0, make_buffer(1, 200)); });
+    EXPECT(queued.wait_for(kTimeout) == std::future_status::ready);
+
+    // the next set is matched and its writer waits for set 0
+    auto next_writer = std::async(std::launch::async, [&] { return synchronizer.submit(1, make_buffer(1, 200)); });
+    EXPECT(next_writer.wait_for(kTimeout / 10) == std::future_status::timeout);
+
+    auto other = std::async(std::launch::async, [&] { return synchronizer.submit(0, make_buffer(2, 300)); });
+    EXPECT(other.wait_for(kTimeout) == std::future_status::ready);
+    EXPECT(first.written().empty());
+
+    first.block(false);
+    EXPECT(writer.get());
+    EXPECT(queued.get());
+    EXPECT(next_writer.get());
+    EXPECT(other.get());
+
+    EXPECT((first.written() == std::vector<uint64_t> { 0, 1 }));
+    EXPECT((second.written() == std::vector<uint64_t> { 0, 1 }));
+    EXPECT(first.released == 2);
+    EXPECT(second.released == 2);
+    EXPECT(metrics.get("sync_sets") == 2);
+}
+
+static void
+test_drop_unmatched()
+{
+    Metrics metrics;
+    TestSource first, second;
+    FrameSynchronizer synchronizer({ &first, &second }, 1000, metrics);
+
+    EXPECT(synchronizer.submit(0, make_buffer(0, 100)));
+    EXPECT(synchronizer.submit(1, make_buffer(0, 5000)));
+    EXPECT(synchronizer.submit(0, make_buffer(1, 5001)));
+
+    EXPECT(first.released == 2);
+    EXPECT(second.released == 1);
+    EXPECT((first.written() == std::vector<uint64_t> { 0 }));
+    EXPECT((second.written() == std::vector<uint64_t> { 0 }));
+    EXPECT(metrics.get("sync_frames_dropped") == 1);
+}
+
+int
+main()
+{
+    test_write_outside_lock();
+    test_drop_unmatched();
+
+    return test_result();
+}
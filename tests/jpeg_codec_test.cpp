@@ -0,0 +1,134 @@
+#include <cstring>
+#include <vector>
+
+#include "easylogging++/easylogging++.h"
+
+#include "jpeg_codec.hpp"
+#include "libjpeg_codec.hpp"
+#include "test_jpeg.hpp"
+#include "test_util.hpp"
+
+INITIALIZE_EASYLOGGINGPP
+
+static const unsigned kWidth = 640;
+static const unsigned kHeight = 480;
+static const int kQuality = 80;
+
+static std::vector<unsigned char>
+recompress(const CodecProfile& profile, const std::vector<unsigned char>& frame)
+{
+    CodecSettings settings;
+    settings.profile = profile;
+
+    std::vector<unsigned char> output;
+    LibJPEGCodec codec(settings);
+    EXPECT(codec.recompress(frame.data(), frame.size(), kQuality, 1, false, output));
+
+    return output;
+}
+
+static bool
+standard_tables(const std::vector<unsigned char>& jpeg)
+{
+    JPEGInfo info;
+    EXPECT(parse_jpeg_header(jpeg.data(), jpeg.size(), info));
+
+    return info.has_dht and info.standard_huffman_tables;
+}
+
+static bool
+same_pixels(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b)
+{
+    LibJPEGCodec codec(CodecSettings {});
+    RGBImage first, second;
+
+    EXPECT(codec.decompress(a.data(), a.size(), 1, first));
+    EXPECT(codec.decompress(b.data(), b.size(), 1, second));
+
+    return first.width == second.width and first.height == second.height
+        and std::memcmp(first.raw_data.get(), second.raw_data.get(), static_cast<size_t>(first.width) * first.height * 3) == 0;
+}
+
+static void
+test_parse_profile()
+{
+    CodecProfile profile;
+
+    EXPECT(parse_codec_profile("fastest", profile) and profile.dct_method == JDCT_IFAST);
+    EXPECT(parse_codec_profile("balanced", profile) and profile.dct_method == JDCT_ISLOW and not profile.optimize_coding);
+    EXPECT(parse_codec_profile("best", profile) and profile.dct_method == JDCT_ISLOW and profile.optimize_coding);
+    EXPECT(not parse_codec_profile("fast", profile));
+}
+
+// Every profile reaches the encoder.
+static void
+test_apply_profile()
+{
+    for (auto name : { "fastest", "balanced", "best" }) {
+        CodecSettings settings;
+        EXPECT(parse_codec_profile(name, settings.profile));
+
+        struct jpeg_compress_struct cinfo;
+        struct jpeg_error_mgr jerr;
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_compress(&cinfo);
+        cinfo.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&cinfo);
+
+        LibJPEGCodec(settings).apply_profile(cinfo);
+        EXPECT(cinfo.dct_method == settings.profile.dct_method);
+        EXPECT(static_cast<bool>(cinfo.optimize_coding) == settings.profile.optimize_coding);
+
+        jpeg_destroy_compress(&cinfo);
+    }
+}
+
+static void
+test_encode_profiles()
+{
+    auto frame = make_test_jpeg(kWidth, kHeight);
+
+    auto fastest = recompress(kFastestProfile, frame);
+    auto balanced = recompress(kBalancedProfile, frame);
+    auto best = recompress(kBestProfile, frame);
+
+    // the fast DCT gives other coefficients
+    EXPECT(fastest != balanced);
+    EXPECT(not same_pixels(fastest, balanced));
+
+    // optimized Huffman tables change the coding only
+    EXPECT(standard_tables(fastest));
+    EXPECT(standard_tables(balanced));
+    EXPECT(not standard_tables(best));
+    EXPECT(best.size() < balanced.size());
+    EXPECT(same_pixels(balanced, best));
+}
+
+// With --rtp the best profile encodes with the standard tables and is
+// otherwise unchanged.
+static void
+test_rtp_profile()
+{
+    auto frame = make_test_jpeg(kWidth, kHeight);
+
+    auto rtp_best = rtp_codec_profile(kBestProfile);
+    EXPECT(not rtp_best.optimize_coding);
+    EXPECT(rtp_best.dct_method == kBestProfile.dct_method);
+
+    auto output = recompress(rtp_best, frame);
+    EXPECT(standard_tables(output));
+    EXPECT(output == recompress(kBalancedProfile, frame));
+
+    EXPECT(rtp_codec_profile(kFastestProfile).dct_method == JDCT_IFAST);
+}
+
+int
+main()
+{
+    test_parse_profile();
+    test_apply_profile();
+    test_encode_profiles();
+    test_rtp_profile();
+
+    return test_result();
+}
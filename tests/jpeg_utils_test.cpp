@@ -0,0 +1,81 @@
+#include <vector>
+
+#include "jpeg_utils.hpp"
+#include "test_jpeg.hpp"
+#include "test_util.hpp"
+
+static const unsigned kWidth = 64;
+static const unsigned kHeight = 48;
+static const int kQuality = 80;
+
+/* offset of the quantization table selector of a component from the SOF marker */
+static size_t
+sof_quant_table_offset(int component)
+{
+    return 2 /* marker */ + 2 /* length */ + 6 + component * 3 + 2;
+}
+
+static void
+test_valid_frame()
+{
+    TestJPEGSettings settings;
+    settings.quality = kQuality;
+    auto jpeg = make_test_jpeg(kWidth, kHeight, settings);
+
+    JPEGInfo info;
+    EXPECT(validate_jpeg(jpeg.data(), jpeg.size(), kWidth, kHeight, info) == JPEGDefect::None);
+    EXPECT(info.components_count == 3);
+    EXPECT(info.components[0].quant_table == 0);
+    EXPECT(info.components[1].quant_table == 1);
+    EXPECT(estimate_jpeg_quality(info) == kQuality);
+}
+
+// A corrupt frame header may point components at any table, the frame has
+// to be rejected before quant_tables[] is indexed with the selector.
+static void
+test_quant_table_selector(int component, unsigned char selector)
+{
+    auto jpeg = make_test_jpeg(kWidth, kHeight);
+
+    JPEGInfo info;
+    EXPECT(parse_jpeg_header(jpeg.data(), jpeg.size(), info));
+    jpeg[info.sof_offset + sof_quant_table_offset(component)] = selector;
+
+    EXPECT(not parse_jpeg_header(jpeg.data(), jpeg.size(), info));
+    EXPECT(validate_jpeg(jpeg.data(), jpeg.size(), kWidth, kHeight, info) == JPEGDefect::Header);
+}
+
+// Without DQT segments (turned into comments here) no table is defined.
+static void
+test_missing_quant_tables()
+{
+    auto jpeg = make_test_jpeg(kWidth, kHeight);
+
+    JPEGInfo info;
+    EXPECT(parse_jpeg_header(jpeg.data(), jpeg.size(), info));
+
+    for (size_t i = 2; i + 1 < info.sos_offset; i++) {
+        if (jpeg[i] == 0xFF and jpeg[i + 1] == 0xDB) {
+            jpeg[i + 1] = 0xFE;
+        }
+    }
+
+    EXPECT(not parse_jpeg_header(jpeg.data(), jpeg.size(), info));
+    EXPECT(validate_jpeg(jpeg.data(), jpeg.size(), kWidth, kHeight, info) == JPEGDefect::Header);
+}
+
+int
+main()
+{
+    test_valid_frame();
+
+    /* selectors beyond the four tables JPEG allows */
+    test_quant_table_selector(0, 4);
+    test_quant_table_selector(1, 0xFF);
+    /* a valid selector of a table the image doesn't define */
+    test_quant_table_selector(0, 2);
+
+    test_missing_quant_tables();
+
+    return test_result();
+}
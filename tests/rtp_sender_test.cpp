@@ -0,0 +1,223 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "easylogging++/easylogging++.h"
+
+#include "jpeg_utils.hpp"
+#include "rtp_sender.hpp"
+#include "test_jpeg.hpp"
+#include "test_util.hpp"
+
+INITIALIZE_EASYLOGGINGPP
+
+static const unsigned kWidth = 320;
+static const unsigned kHeight = 240;
+static const size_t kPacketSize = 400;
+static const size_t kMaxPacketSize = 2048;
+
+static const size_t kRTPHeaderSize = 12;
+static const size_t kJPEGHeaderSize = 8;
+static const size_t kRestartMarkerHeaderSize = 4;
+static const size_t kQuantTableHeaderSize = 4;
+
+static std::vector<unsigned char>
+make_jpeg(int h_sampling, int v_sampling, unsigned restart_interval, bool optimize_coding)
+{
+    TestJPEGSettings settings;
+    settings.h_sampling = h_sampling;
+    settings.v_sampling = v_sampling;
+    settings.restart_interval = restart_interval;
+    settings.optimize_coding = optimize_coding;
+
+    return make_test_jpeg(kWidth, kHeight, settings);
+}
+
+static int
+open_receiver(uint16_t& port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    socklen_t addr_len = sizeof(addr);
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0
+        or getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    port = ntohs(addr.sin_port);
+
+    return fd;
+}
+
+// Reads packets of a single frame up to the one with the marker bit and
+// puts the fragments back together at their offsets.
+static bool
+reassemble(int fd, std::vector<unsigned char>& scan, uint8_t& type, std::vector<unsigned char>& quant_tables)
+{
+    std::vector<unsigned char> packet(kMaxPacketSize);
+    bool first = true;
+    uint16_t expected_sequence = 0;
+
+    scan.clear();
+
+    for (;;) {
+        auto rc = recv(fd, packet.data(), packet.size(), 0);
+        if (rc < static_cast<ssize_t>(kRTPHeaderSize + kJPEGHeaderSize)) {
+            return false;
+        }
+
+        size_t size = rc;
+        EXPECT(size <= kPacketSize);
+        EXPECT((packet[0] >> 6) == 2);
+        EXPECT((packet[1] & 0x7F) == 26);
+
+        uint16_t sequence = (packet[2] << 8) | packet[3];
+        EXPECT(first or sequence == expected_sequence);
+        expected_sequence = sequence + 1;
+
+        const unsigned char* p = packet.data() + kRTPHeaderSize;
+        size_t offset = (p[1] << 16) | (p[2] << 8) | p[3];
+        type = p[4];
+        uint8_t q = p[5];
+        p += kJPEGHeaderSize;
+
+        if (type & 64) {
+            p += kRestartMarkerHeaderSize;
+        }
+
+        if (offset == 0 and q >= 128) {
+            size_t length = (p[2] << 8) | p[3];
+            p += kQuantTableHeaderSize;
+            quant_tables.assign(p, p + length);
+            p += length;
+        }
+
+        EXPECT(first == (offset == 0));
+        first = false;
+
+        size_t payload_size = packet.data() + size - p;
+        if (scan.size() < offset + payload_size) {
+            scan.resize(offset + payload_size);
+        }
+        std::memcpy(scan.data() + offset, p, payload_size);
+
+        if (packet[1] & 0x80) {
+            return true;
+        }
+    }
+}
+
+static void
+test_loopback(int h_sampling, int v_sampling, unsigned restart_interval)
+{
+    auto jpeg = make_jpeg(h_sampling, v_sampling, restart_interval, false);
+
+    JPEGInfo info;
+    EXPECT(parse_jpeg_header(jpeg.data(), jpeg.size(), info));
+    EXPECT(info.has_dht and info.standard_huffman_tables);
+
+    uint16_t port;
+    int fd = open_receiver(port);
+    EXPECT(fd != -1);
+    if (fd == -1) {
+        return;
+    }
+
+    RTPJPEGSender sender;
+    EXPECT(sender.open("127.0.0.1:" + std::to_string(port), kPacketSize));
+
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    bool supported = false;
+    EXPECT(sender.send(jpeg.data(), jpeg.size(), now, supported));
+    EXPECT(supported);
+
+    std::vector<unsigned char> scan;
+    std::vector<unsigned char> quant_tables;
+    uint8_t type = 0;
+    EXPECT(reassemble(fd, scan, type, quant_tables));
+
+    uint8_t expected_type = (v_sampling == 2 ? 1 : 0) | (restart_interval > 0 ? 64 : 0);
+    EXPECT(type == expected_type);
+    EXPECT(quant_tables.size() == 2 * kJPEGQuantTableSize);
+    EXPECT(scan.size() == info.scan_size);
+    EXPECT(std::memcmp(scan.data(), jpeg.data() + info.scan_offset, std::min(scan.size(), info.scan_size)) == 0);
+
+    close(fd);
+}
+
+// Frames RTP/JPEG can't carry are skipped without failing the output.
+static void
+test_unsupported(const std::vector<unsigned char>& jpeg)
+{
+    uint16_t port;
+    int fd = open_receiver(port);
+    EXPECT(fd != -1);
+    if (fd == -1) {
+        return;
+    }
+
+    RTPJPEGSender sender;
+    EXPECT(sender.open("127.0.0.1:" + std::to_string(port), kPacketSize));
+
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    bool supported = true;
+    EXPECT(sender.send(jpeg.data(), jpeg.size(), now, supported));
+    EXPECT(not supported);
+
+    unsigned char packet[kMaxPacketSize];
+    EXPECT(recv(fd, packet, sizeof(packet), MSG_DONTWAIT) == -1);
+
+    close(fd);
+}
+
+static void
+test_optimized_huffman_tables()
+{
+    auto jpeg = make_jpeg(2, 2, 0, true);
+
+    JPEGInfo info;
+    EXPECT(parse_jpeg_header(jpeg.data(), jpeg.size(), info));
+    EXPECT(info.has_dht and not info.standard_huffman_tables);
+
+    test_unsupported(jpeg);
+}
+
+int
+main()
+{
+    test_loopback(2, 2, 0);
+    test_loopback(2, 1, 0);
+    test_loopback(2, 2, 4);
+    test_optimized_huffman_tables();
+    /* 4:4:4 */
+    test_unsupported(make_jpeg(1, 1, 0, false));
+    /* too wide */
+    test_unsupported(make_test_jpeg(kRTPJPEGMaxDimension + 16, 16));
+
+    return test_result();
+}
@@ -0,0 +1,115 @@
+#include <dirent.h>
+#include <fcntl.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "easylogging++/easylogging++.h"
+
+#include "frame_storage.hpp"
+
+INITIALIZE_EASYLOGGINGPP
+
+static const size_t kFileSize = 4096;
+
+using Clock = std::chrono::steady_clock;
+
+static double
+seconds_since(Clock::time_point started)
+{
+    return std::chrono::duration<double>(Clock::now() - started).count();
+}
+
+// What ls -l, rsync or a cleanup script do with a directory: read it and stat() every entry.
+static double
+list_directory_ms(const std::string& path)
+{
+    auto started = Clock::now();
+
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return -1;
+    }
+
+    struct stat st;
+    while (auto entry = readdir(dir)) {
+        fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW);
+    }
+    closedir(dir);
+
+    return seconds_since(started) * 1000;
+}
+
+static std::string
+bucket_path(const std::string& root, uint64_t bucket)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%06llu", static_cast<unsigned long long>(bucket));
+
+    return root + "/" + name;
+}
+
+// Writes files through FrameStorage with counter sharding and reports the file
+// creation rate and the time to list the directory being filled. A shard size
+// of 0 puts all files in one directory. Drop caches or sync between runs, the
+// writeback of a previous run skews the rates.
+//
+//   shard_benchmark <empty directory> <files> <shard size> [report every]
+int
+main(int argc, char* argv[])
+{
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " <empty directory> <files> <shard size> [report every]" << std::endl;
+        return 1;
+    }
+
+    std::string root = argv[1];
+    uint64_t files = std::strtoull(argv[2], nullptr, 10);
+    unsigned shard_size = std::strtoul(argv[3], nullptr, 10);
+    uint64_t step = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 100000;
+
+    if (files == 0 or step == 0) {
+        std::cerr << "invalid arguments" << std::endl;
+        return 1;
+    }
+
+    FrameStorage storage;
+    if (not storage.configure(shard_size > 0 ? ShardMode::Counter : ShardMode::None, shard_size > 0 ? shard_size : 1)) {
+        return 1;
+    }
+
+    std::vector<unsigned char> data(kFileSize, 0xA5);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    auto started = Clock::now();
+
+    for (uint64_t i = 0; i < files; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%010llu.jpg", static_cast<unsigned long long>(i));
+
+        if (not storage.write(root + name, i, now, data.data(), data.size())) {
+            return 1;
+        }
+
+        if ((i + 1) % step == 0) {
+            auto rate = step / seconds_since(started);
+            auto directory = shard_size > 0 ? bucket_path(root, i / shard_size) : root;
+
+            std::cout << i + 1 << " files: " << static_cast<uint64_t>(rate) << " files/s, listing " << directory << ": "
+                      << list_directory_ms(directory) << " ms" << std::endl;
+
+            started = Clock::now();
+        }
+    }
+
+    return storage.flush() ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#ifndef UVCCAPTURE2_TEST_JPEG_HPP
+#define UVCCAPTURE2_TEST_JPEG_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "jpeg_utils.hpp"
+
+// Synthetic frames for the test programs: gradients with a checkerboard, so
+// images have both smooth areas and sharp edges.
+
+static inline std::vector<unsigned char>
+make_test_image(unsigned width, unsigned height)
+{
+    std::vector<unsigned char> image(width * height * 3);
+
+    for (unsigned y = 0; y < height; y++) {
+        for (unsigned x = 0; x < width; x++) {
+            unsigned char* p = image.data() + (y * width + x) * 3;
+            p[0] = x * 255 / width;
+            p[1] = y * 255 / height;
+            p[2] = (((x / 16) ^ (y / 16)) & 1) ? 200 : 30;
+        }
+    }
+
+    return image;
+}
+
+struct TestJPEGSettings {
+    int quality = 80;
+    int h_sampling = 2;
+    int v_sampling = 2;
+    unsigned restart_interval = 0;
+    bool optimize_coding = false;
+};
+
+static inline std::vector<unsigned char>
+encode_test_jpeg(const std::vector<unsigned char>& image, unsigned width, unsigned height, const TestJPEGSettings& settings)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    std::vector<unsigned char> jpeg;
+    JPEGVectorDestination dest;
+    jpeg_vector_dest(&cinfo, dest, jpeg);
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, settings.quality, TRUE);
+    cinfo.comp_info[0].h_samp_factor = settings.h_sampling;
+    cinfo.comp_info[0].v_samp_factor = settings.v_sampling;
+    cinfo.restart_interval = settings.restart_interval;
+    cinfo.optimize_coding = settings.optimize_coding ? TRUE : FALSE;
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = const_cast<unsigned char*>(image.data()) + cinfo.next_scanline * width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    return jpeg;
+}
+
+static inline std::vector<unsigned char>
+make_test_jpeg(unsigned width, unsigned height, const TestJPEGSettings& settings = TestJPEGSettings())
+{
+    return encode_test_jpeg(make_test_image(width, height), width, height, settings);
+}
+
+// Peak signal-to-noise ratio of two 8-bit images of the same size, in dB.
+static inline double
+psnr(const unsigned char* a, const unsigned char* b, size_t size)
+{
+    if (size == 0) {
+        return 0;
+    }
+
+    double mse = 0;
+    for (size_t i = 0; i < size; i++) {
+        double d = static_cast<double>(a[i]) - b[i];
+        mse += d * d;
+    }
+    mse /= size;
+
+    return mse == 0 ? INFINITY : 10 * std::log10(255.0 * 255.0 / mse);
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef UVCCAPTURE2_TEST_UTIL_HPP
+#define UVCCAPTURE2_TEST_UTIL_HPP
+
+#include <iostream>
+
+// Checks shared by the test programs: a failed EXPECT() is reported and
+// counted, the test goes on and test_result() turns the count into the exit
+// code. (CHECK is already taken by easylogging++.)
+
+static int test_failures = 0;
+
+#define EXPECT(expr)                                                                                                                \
+    do {                                                                                                                            \
+        if (not(expr)) {                                                                                                            \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #expr << std::endl;                                      \
+            test_failures++;                                                                                                        \
+        }                                                                                                                           \
+    } while (0)
+
+static inline int
+test_result()
+{
+    if (test_failures > 0) {
+        std::cerr << test_failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+#endif
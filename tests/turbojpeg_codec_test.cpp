@@ -0,0 +1,100 @@
+#include <cmath>
+#include <vector>
+
+#include "easylogging++/easylogging++.h"
+
+#include "jpeg_codec.hpp"
+#include "libjpeg_codec.hpp"
+#include "test_jpeg.hpp"
+#include "test_util.hpp"
+
+INITIALIZE_EASYLOGGINGPP
+
+static const unsigned kWidth = 1920;
+static const unsigned kHeight = 1080;
+static const int kCameraQuality = 90;
+static const int kQuality = 80;
+static const double kMinPSNR = 45.0;
+static const double kMaxSizeDifference = 0.02;
+
+static size_t
+image_size(const RGBImage& image)
+{
+    return static_cast<size_t>(image.width) * image.height * 3;
+}
+
+static double
+psnr(const RGBImage& a, const RGBImage& b)
+{
+    if (a.width != b.width or a.height != b.height) {
+        return 0;
+    }
+
+    return psnr(a.raw_data.get(), b.raw_data.get(), image_size(a));
+}
+
+static double
+size_difference(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b)
+{
+    return std::fabs(static_cast<double>(a.size()) - b.size()) / b.size();
+}
+
+// Both backends decode a frame to the same pixels and encode an image to
+// practically the same JPEG, so --codec doesn't change the results.
+int
+main()
+{
+    TestJPEGSettings camera;
+    camera.quality = kCameraQuality;
+    camera.v_sampling = 1;
+    auto frame = make_test_jpeg(kWidth, kHeight, camera);
+
+    LibJPEGCodec libjpeg(CodecSettings {});
+    auto turbojpeg = create_jpeg_codec("turbojpeg", CodecSettings());
+    if (not turbojpeg) {
+        return 1;
+    }
+
+    // decoding, as done for --stack
+    RGBImage libjpeg_image, turbojpeg_image;
+    EXPECT(libjpeg.decompress(frame.data(), frame.size(), 1, libjpeg_image));
+    EXPECT(turbojpeg->decompress(frame.data(), frame.size(), 1, turbojpeg_image));
+    EXPECT(psnr(libjpeg_image, turbojpeg_image) >= kMinPSNR);
+
+    EXPECT(libjpeg.decompress(frame.data(), frame.size(), 2, libjpeg_image));
+    EXPECT(turbojpeg->decompress(frame.data(), frame.size(), 2, turbojpeg_image));
+    EXPECT(turbojpeg_image.width == kWidth / 2 and turbojpeg_image.height == kHeight / 2);
+    EXPECT(psnr(libjpeg_image, turbojpeg_image) >= kMinPSNR);
+
+    // re-encoding through RGB and in YCbCr
+    for (auto keep_ycbcr : { false, true }) {
+        std::vector<unsigned char> libjpeg_output, turbojpeg_output;
+        EXPECT(libjpeg.recompress(frame.data(), frame.size(), kQuality, 1, keep_ycbcr, libjpeg_output));
+        EXPECT(turbojpeg->recompress(frame.data(), frame.size(), kQuality, 1, keep_ycbcr, turbojpeg_output));
+        EXPECT(size_difference(turbojpeg_output, libjpeg_output) <= kMaxSizeDifference);
+
+        JPEGInfo info;
+        EXPECT(parse_jpeg_header(turbojpeg_output.data(), turbojpeg_output.size(), info));
+        EXPECT(info.components[0].v_sampling == (keep_ycbcr ? 1 : 2));
+
+        EXPECT(libjpeg.decompress(libjpeg_output.data(), libjpeg_output.size(), 1, libjpeg_image));
+        EXPECT(libjpeg.decompress(turbojpeg_output.data(), turbojpeg_output.size(), 1, turbojpeg_image));
+        EXPECT(psnr(libjpeg_image, turbojpeg_image) >= kMinPSNR);
+    }
+
+    // encoding of uncompressed frames
+    YCbCrImage ycbcr;
+    bool supported = true;
+    EXPECT(libjpeg.decompress_ycbcr(frame.data(), frame.size(), ycbcr, supported));
+
+    std::vector<unsigned char> libjpeg_output, turbojpeg_output;
+    EXPECT(libjpeg.compress(ycbcr, kQuality, libjpeg_output));
+    EXPECT(turbojpeg->compress(ycbcr, kQuality, turbojpeg_output));
+    EXPECT(size_difference(turbojpeg_output, libjpeg_output) <= kMaxSizeDifference);
+
+    EXPECT(libjpeg.decompress(libjpeg_output.data(), libjpeg_output.size(), 1, libjpeg_image));
+    EXPECT(libjpeg.decompress(turbojpeg_output.data(), turbojpeg_output.size(), 1, turbojpeg_image));
+    EXPECT(psnr(libjpeg_image, turbojpeg_image) >= kMinPSNR);
+
+    return test_result();
+}